@@ -7,6 +7,7 @@
 #include "usb.h"
 #include "i2c.h"
 #include "tools.h"
+#include "errorcodes.h"
 #include "menu.h"
 
 
@@ -17,8 +18,9 @@
 /////////////////////////////////////////////////////////////////////////
 void Application (void)
 {
-   BYTE i;
-   CHAR tmp[9];
+   BYTE   i;
+   CHAR   tmp[9];
+   s_work work;
    
    while(1)
    {
@@ -26,11 +28,16 @@ void Application (void)
       if(System.EventID & EVENT_BOX_OPENED)
       {
          InitLCD();                     // init display
-         BoxOpenedLogData2Stick();      // safe logged measurements from external EEPROM to USb-Stick
-         StartMenu();                   // display menu
          ClearEvent(EVENT_BOX_OPENED);
          GIFR |= 0x40;                  // clear int-flag
          EnableBoxSwitchInt();          // enable int by box-switch
+         BoxOpenedLogData2Stick();      // safe logged measurements from external EEPROM to USb-Stick -> menu follows
+      }
+
+
+      if(System.EventID & EVENT_USB_EXPORT)                       // safe logs to USB-stick -> one block per turn
+      {
+         BoxOpenedLogData2StickService();
       }
 
 
@@ -61,13 +68,28 @@ void Application (void)
           ClearTimeCallback(EVENT_CALLBACK_CLR_IMP_SIGNAL);
         }
 
+        if(System.CallbackEvent & EVENT_CALLBACK_START_MENU)
+          BoxOpenedStartMenu();                                    // result of saving logs was shown
+
         ClearEvent(EVENT_TIME_CALLBACK);
       }
 
 
       if(System.EventID & EVENT_KEY_CHANGED)                      // update menu after key pressed
       {
-         DoMenu(System.Key.Valid);
+         if(IsUSB_ExportActive())                                 // saving logs to USB-stick
+         {
+            if(System.Key.Valid == KEY_ESCAPE)                     // abort -> next export continues
+            {
+               USB_LogSensorValuesAbort();
+               BoxOpenedStartMenu();
+            }
+         }
+         else if(System.CallbackEvent & EVENT_CALLBACK_START_MENU)
+            BoxOpenedStartMenu();                                  // skip showing the result
+         else
+            DoMenu(System.Key.Valid);
+
          ClearEvent(EVENT_KEY_CHANGED);
       }
 
@@ -79,7 +101,26 @@ void Application (void)
          SensorService();
          ClearEvent(EVENT_RTC_INTERRUPT);
          EnableRTC_Int();
-         PowerSaveModeEnable();              // set power-down-mode
+      }
+
+
+      if(System.EventID & EVENT_WORK_PENDING)                     // work deferred by interrupts
+      {
+         while(GetWork(&work))
+         {
+            switch(work.ID)
+            {
+               case WORK_USB_SESSION_SERVICE :
+                     USB_SessionService(work.Timestamp);  // power-off an idle uALFAT
+                  break;
+            }
+         }
+
+         if(System.Work.Lost)                                     // Application() was blocked too long
+         {
+            MutexFunc(System.Work.Lost = 0);
+            SafeErrorsToEEPROM(ERROR_SYSTEM_WORK_LOST);
+         }
       }
 
 
@@ -89,7 +130,13 @@ void Application (void)
       }
 
 
-      if(System.EventTimer & EVENT_FASTLOGGING_SAFE2_USB)
+      if(System.EventID & EVENT_ADC_READY)                        // ADC finished requested channels
+      {
+         ClearEvent(EVENT_ADC_READY);        // fast-samples are already stored by the ADC-interrupt
+      }
+
+
+      if((System.EventTimer & EVENT_FASTLOGGING_SAFE2_USB) && !IsUSB_ExportActive())   // uALFAT is busy -> later
       {
          ClearTimerEvent(EVENT_FASTLOGGING_SAFE2_USB);
          USB_LogSensorValuesFast();
@@ -99,7 +146,7 @@ void Application (void)
       if(System.EventTimer & EVENT_UPDATE_DISPLAY_VALUE)
       {
          ClearTimerEvent(EVENT_UPDATE_DISPLAY_VALUE);
-         if(IsBoxOpen())
+         if(IsBoxOpen() && !IsUSB_ExportActive() && !(System.CallbackEvent & EVENT_CALLBACK_START_MENU))
          {
             for(i=0; i<NUM_SENSOR; i++)
             {
@@ -131,13 +178,17 @@ void Application (void)
             }
          }
       }
+
+
+      SystemSleep();                   // sleep till the next event
    }
 }
 
 
 
 /////////////////////////////////////////////////////////////////////////
-// function : main application -> dispense different events            //
+// function : box opened -> start saving the logged measurements to    //
+//            USB-stick, the menu is shown when it's finished          //
 // given    : nothing                                                  //
 // return   : nothing                                                  //
 /////////////////////////////////////////////////////////////////////////
@@ -148,11 +199,59 @@ void BoxOpenedLogData2Stick(void)
   PrintLCD(1,1,STRING_SAFE_DATA_TO_STICK1);
   PrintLCD(1,2,STRING_SAFE_DATA_TO_STICK2);
 
-  if(USB_LogSensorValues())
-    PrintLCD(15,2,STRING_DONE);
-  else
-    PrintLCD(15,2,STRING_ERROR);
+  USB_LogSensorValuesStart();
+}
+
+
+
+/////////////////////////////////////////////////////////////////////////
+// function : safe the next log-block to USB-stick + show the progress //
+// given    : nothing                                                  //
+// return   : nothing                                                  //
+/////////////////////////////////////////////////////////////////////////
+void BoxOpenedLogData2StickService(void)
+{
+  CHAR  tmp[5];
+
+  switch(USB_LogSensorValuesStep())
+  {
+    case USB_EXPORT_DONE :
+          PrintLCD(13,2,"  ");
+          PrintLCD(15,2,STRING_DONE);
+          SetTimeCallback(EVENT_CALLBACK_START_MENU, 1000);   // show result for 1000ms
+       break;
+
+    case USB_EXPORT_ERROR :
+          PrintLCD(13,2,"  ");
+          PrintLCD(15,2,STRING_ERROR);
+          SetTimeCallback(EVENT_CALLBACK_START_MENU, 1000);   // show result for 1000ms
+       break;
+
+    case USB_EXPORT_BLOCK :
+          Byte2AsciiDec(USB_LogSensorValuesProgress(), (BYTE*)&tmp[0], UNSIGNED_BYTE);
+          if(tmp[0] == '0')                                   // remove leading zeros
+          {
+            tmp[0] = ' ';
+            if(tmp[1] == '0')
+              tmp[1] = ' ';
+          }
+          tmp[3] = '%';
+          tmp[4] = 0x00;
+          PrintLCD(13,2,&tmp[0]);
+       break;
+  }
+}
+
 
-  Sleep(1000);
+
+/////////////////////////////////////////////////////////////////////////
+// function : saving logs to USB-stick finished -> display menu        //
+// given    : nothing                                                  //
+// return   : nothing                                                  //
+/////////////////////////////////////////////////////////////////////////
+void BoxOpenedStartMenu(void)
+{
+  ClearTimeCallback(EVENT_CALLBACK_START_MENU);
   Cursor(CURSOR_OFF, CURSOR_STEADY);
+  StartMenu();                   // display menu
 }
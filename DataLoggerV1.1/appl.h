@@ -6,5 +6,9 @@ void Application (void);
 
 void BoxOpenedLogData2Stick(void);
 
+void BoxOpenedLogData2StickService(void);
+
+void BoxOpenedStartMenu(void);
+
 
 #endif
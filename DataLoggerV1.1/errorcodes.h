@@ -21,12 +21,15 @@
 #define ERROR_EEPROM_WRITE_NO_STARTCOND_SENT              0x0121
 #define ERROR_EEPROM_WRITE_NO_ADDR_ACK_RECEIVED           0x0122
 #define ERROR_EEPROM_WRITE_NO_DATA_ACK_RECEIVED           0x0123
+#define ERROR_EEPROM_WRITE_TIMEOUT                        0x0124
 
 #define ERROR_EEPROM_READ_NO_STARTCOND_SENT               0x0131
 #define ERROR_EEPROM_READ_NO_ADDR_ACK_RECEIVED            0x0132
 #define ERROR_EEPROM_READ_NO_DATA_ACK_RECEIVED            0x0133
 #define ERROR_EEPROM_READ_NO_ADDR_ACK_AGAIN_RECEIVED      0x0134
 
+#define ERROR_EEPROM_LOG_BLOCK_CORRUPTED                  0x0135
+
 
 
 // errorcodes for onboard temperature-sensor
@@ -72,5 +75,6 @@
 
 // errorcode of system
 #define ERROR_SYSTEM                                      0x9900
+#define ERROR_SYSTEM_WORK_LOST                            0x9920   // deferred work dropped (queue full)
 
 #endif
@@ -5,6 +5,16 @@
 
 
 s_timestamp    CodedTimestamp;
+s_ext_eeprom   ExtEeprom;
+s_eeprom_stream  EepromStream;
+s_twi_engine   TwiEngine;
+
+// device-address of each 64kB segment of the external EEPROM
+// -> up to 4 chips of max. 64kB (24C512), strapped by A2/A1, A0 = 0 (0xA2 is the RTC)
+// -> parts > 64kB are not supported beyond their first 64kB : their block-select
+//    bit is a device-address bit (AT24CM01 -> 0xA2, 24LC1025 -> 0xA8)
+const BYTE EepromSegmentAddr[EXT_EEPROM_MAX_SEGMENTS] = {0xA0, 0xA4, 0xA8, 0xAC};
+#define  EEPROM_DeviceAddr(addr)    (EepromSegmentAddr[(BYTE)((addr) >> 16)])
 
 
 /////////////////////////////////////////////////////////////////////////
@@ -119,29 +129,209 @@ void ReadOnboardTemp(void)
 
 
 /////////////////////////////////////////////////////////////////////////
-// function : hw-specifc I2C write using ATmega's TWI                  //
-// given    : data = send data to I2C slave                            //
+// function : queue a job for the TWI-interrupt -> the job is started  //
+//            at once if the bus is idle, else after the queued ones   //
+//            the job has to stay valid till its status is set         //
+// given    : job                                                      //
+// return   : TRUE if queued, FALSE if queue is full                   //
+/////////////////////////////////////////////////////////////////////////
+BYTE I2C_Submit(s_i2c_job* job)
+{
+   BYTE head;
+   BYTE ret = FALSE;
+
+   job->Status = I2C_JOB_PENDING;
+
+   GetMutex();
+   head = (TwiEngine.Head + 1) & (I2C_QUEUE_SIZE - 1);
+   if(head != TwiEngine.Tail)
+   {
+      TwiEngine.Queue[TwiEngine.Head] = job;
+      if(TwiEngine.Head == TwiEngine.Tail)     // bus idle -> start the job
+         TWCR = I2C_CTRL_START;
+      TwiEngine.Head = head;
+      ret = TRUE;
+   }
+   else
+      job->Status = I2C_JOB_NO_STARTCOND;     // queue full -> job is lost
+   ReleaseMutex();
+
+   return ret;
+}
+
+
+
+/////////////////////////////////////////////////////////////////////////
+// function : wait till the TWI-interrupt finished the given job       //
+//            -> CPU sleeps in idle, other interrupts keep running     //
+// given    : job                                                      //
 // return   : nothing                                                  //
 /////////////////////////////////////////////////////////////////////////
-void I2C_Write_Byte(BYTE data)
+void I2C_WaitJob(s_i2c_job* job)
 {
-   TWDR = data;
-   TWCR = (TWCR & 0x0F) | (1<<TWINT) | (1<<TWEN);
+   set_sleep_mode(SLEEP_MODE_IDLE);
+
+   DisableGlobalInterrupt();
+   while(job->Status == I2C_JOB_PENDING)
+   {
+      sleep_enable();
+      EnableGlobalInterrupt();           // sleep is executed before a pending int
+      sleep_cpu();
+      sleep_disable();
+      DisableGlobalInterrupt();
+   }
+   EnableGlobalInterrupt();
 }
 
 
 
 /////////////////////////////////////////////////////////////////////////
-// function : hw-specifc I2C read using ATmega's TWI                   //
-// given    : ack = should ATmega send an ACK                          //
+// function : do the next step of the running job -> TWI-interrupt     //
+//            start, device-address, register-address (MSB first),    //
+//            data or repeated start + device-address + data, stop     //
+// given    : nothing                                                  //
 // return   : nothing                                                  //
 /////////////////////////////////////////////////////////////////////////
-void I2C_Read_Byte(BYTE ack)
+void I2C_NextStep(void)
 {
-   if(ack)
-      TWCR = ((TWCR & 0x0F) | (1<<TWINT) | (1<<TWEA) );
+   s_i2c_job* job = TwiEngine.Queue[TwiEngine.Tail];
+   BYTE pos = TwiEngine.Pos;
+   BYTE reg = job->Flags & 0x03;            // bytes of the register-address
+
+   switch(TWSR & 0xF8)
+   {
+      case I2C_FLAG_START :
+         TwiEngine.Pos = 0;
+         TWDR = job->Dev;
+         TWCR = I2C_CTRL_NEXT;
+         break;
+
+      case I2C_FLAG_START_REPEATED :
+         TWDR = job->Dev | 0x01;
+         TWCR = I2C_CTRL_NEXT;
+         break;
+
+      case I2C_FLAG_ADDR_TX_ACK_OK :
+      case I2C_FLAG_DATA_TX_ACK_OK :
+         if(pos < reg)                       // register-address
+         {
+            TWDR = (BYTE)(job->RegAddr >> ((reg - 1 - pos) << 3));
+            TwiEngine.Pos++;
+            TWCR = I2C_CTRL_NEXT;
+         }
+         else if(job->Flags & I2C_JOB_READ)
+            TWCR = I2C_CTRL_START;           // repeated start
+         else if(pos < (reg + job->Len))     // data to write
+         {
+            TWDR = job->Data[pos - reg];
+            TwiEngine.Pos++;
+            TWCR = I2C_CTRL_NEXT;
+         }
+         else
+            I2C_Finish(I2C_JOB_DONE);
+         break;
+
+      case I2C_FLAG_ADDR_TX_AGAIN_ACK_OK :
+         TwiEngine.Pos = 0;
+         TWCR = (job->Len > 1) ? I2C_CTRL_NEXT_ACK : I2C_CTRL_NEXT;   // last byte is not ACKed
+         break;
+
+      case I2C_FLAG_DATA_RX_ACK :
+         job->Data[pos++] = TWDR;
+         TwiEngine.Pos = pos;
+         TWCR = (pos < (job->Len - 1)) ? I2C_CTRL_NEXT_ACK : I2C_CTRL_NEXT;
+         break;
+
+      case I2C_FLAG_DATA_RX_NACK :
+         job->Data[pos] = TWDR;
+         I2C_Finish(I2C_JOB_DONE);
+         break;
+
+      case I2C_FLAG_NO_ADDR_TX_ACK       : I2C_Finish(I2C_JOB_NO_ADDR_ACK);       break;
+      case I2C_FLAG_NO_DATA_TX_ACK       : I2C_Finish(I2C_JOB_NO_DATA_ACK);       break;
+      case I2C_FLAG_NO_ADDR_TX_AGAIN_ACK : I2C_Finish(I2C_JOB_NO_ADDR_ACK_AGAIN); break;
+      default                            : I2C_Finish(I2C_JOB_NO_STARTCOND);      break;   // bus-error, arbitration lost
+   }
+}
+
+
+
+/////////////////////////////////////////////////////////////////////////
+// function : stop the running job, post its completion and start the  //
+//            next queued job -> TWI is disabled if none is left       //
+// given    : status of the job (I2C_JOB_xxx)                          //
+// return   : nothing                                                  //
+/////////////////////////////////////////////////////////////////////////
+void I2C_Finish(BYTE status)
+{
+   s_i2c_job* job = TwiEngine.Queue[TwiEngine.Tail];
+
+   TWCR = I2C_CTRL_STOP;
+   I2C_WaitStop();                          // stop takes some us -> no interrupt
+
+   job->Status = status;
+   if(job->Work != WORK_NO_WORK)
+      PostWork(job->Work);
+
+   TwiEngine.Tail = (TwiEngine.Tail + 1) & (I2C_QUEUE_SIZE - 1);
+   if(TwiEngine.Tail != TwiEngine.Head)
+      TWCR = I2C_CTRL_START;                 // next job
    else
-      TWCR = ((TWCR & 0x0F) | (1<<TWINT) );
+      I2C_DisableI2C();                      // start is done again at the next job
+}
+
+
+
+/////////////////////////////////////////////////////////////////////////
+// function : do a job and wait till it is finished                    //
+// given    : dev     = device-address for writing                     //
+//            flags   = I2C_JOB_xxx                                    //
+//            RegAddr = register-address                               //
+//            len     = number of bytes                                //
+//            data    = data                                           //
+//            error   = errorcode of I2C_JOB_NO_STARTCOND of the device//
+// return   : TRUE if OK - FALSE if failed                             //
+/////////////////////////////////////////////////////////////////////////
+WORD I2C_Transfer(BYTE dev, BYTE flags, WORD RegAddr, BYTE len, BYTE* data, WORD error)
+{
+   s_i2c_job job;
+
+   job.Dev     = dev;
+   job.Flags   = flags;
+   job.RegAddr = RegAddr;
+   job.Len     = len;
+   job.Data    = data;
+   job.Work    = WORK_NO_WORK;
+
+   I2C_Submit(&job);
+   I2C_WaitJob(&job);
+
+   if(job.Status != I2C_JOB_DONE)
+     return I2C_Error(error + job.Status - I2C_JOB_NO_STARTCOND);
+
+   return TRUE;
+}
+
+
+
+/////////////////////////////////////////////////////////////////////////
+// function : send only the device-address -> check if it ACKs         //
+// given    : device-address for writing                               //
+// return   : status of the job (I2C_JOB_xxx)                          //
+/////////////////////////////////////////////////////////////////////////
+BYTE I2C_Probe(BYTE dev)
+{
+   s_i2c_job job;
+
+   job.Dev   = dev;
+   job.Flags = 0;
+   job.Len   = 0;
+   job.Work  = WORK_NO_WORK;
+
+   I2C_Submit(&job);
+   I2C_WaitJob(&job);
+
+   return job.Status;
 }
 
 
@@ -153,15 +343,16 @@ void I2C_Read_Byte(BYTE ack)
 //            data    = data                                           //
 // return   : nothing                                                  //
 /////////////////////////////////////////////////////////////////////////
-WORD EEPROM_Bulk_Write(WORD RegAddr, BYTE len, BYTE* data)
+WORD EEPROM_Bulk_Write(LONG RegAddr, BYTE len, BYTE* data)
 {
   BYTE rest;
 
-  if((RegAddr & 0xFF80) == ((RegAddr + len - 1) & 0xFF80))  // check if page-write is possible
+  rest = ExtEeprom.PageSize - (BYTE)(RegAddr & (ExtEeprom.PageSize-1));  // calc rest of page (see datasheet)
+
+  if(len <= rest)                              // check if page-write is possible
     return EEPROM_Bulk_Write_Page(RegAddr, len, data);
   else
   {
-    rest = 0x0080 - (RegAddr & 0x007F);        // calc rest of 128bytes (see datasheet)
 
     if(!EEPROM_Bulk_Write_Page(RegAddr, rest, data))
       return FALSE;
@@ -186,45 +377,57 @@ WORD EEPROM_Bulk_Write(WORD RegAddr, BYTE len, BYTE* data)
 //            data    = data                                           //
 // return   : TRUE if OK - FALSE if write failed                       //
 /////////////////////////////////////////////////////////////////////////
-WORD EEPROM_Bulk_Write_Page(WORD RegAddr, BYTE len, BYTE* data)
+WORD EEPROM_Bulk_Write_Page(LONG RegAddr, BYTE len, BYTE* data)
 {
+  BYTE dev = EEPROM_DeviceAddr(RegAddr);
+
+  EEPROM_Stream_Close();                   // read-ahead may contain the old data
+
   EepromWriteEnable();                     // disable write protection
 
-  I2C_SendStart();                         // set startcondition
-  I2C_Wait();
-  if((TWSR & 0xF8) != I2C_FLAG_START)      // check if error occoured at startcondition
-    return I2C_Error(ERROR_EEPROM_WRITE_NO_STARTCOND_SENT);
+  if(!I2C_Transfer(dev, I2C_JOB_REG16, (WORD)RegAddr, len, data, ERROR_EEPROM_WRITE_NO_STARTCOND_SENT))
+    return FALSE;
 
-  I2C_Write_Byte(HW_ADDRESS_EEPROM);       // write device-address of EEPROM
-  I2C_Wait();
-  if((TWSR & 0xF8) != I2C_FLAG_ADDR_TX_ACK_OK)
-    return I2C_Error(ERROR_EEPROM_WRITE_NO_ADDR_ACK_RECEIVED);
+  if(!EEPROM_WaitWriteCycle(dev))   // wait till all data is written (see datasheet)
+    return FALSE;
 
-  I2C_Write_Byte(RegAddr >> 8);
-  I2C_Wait();
-  if((TWSR & 0xF8) != I2C_FLAG_DATA_TX_ACK_OK)
-    return I2C_Error(ERROR_EEPROM_WRITE_NO_DATA_ACK_RECEIVED);
+  EepromWriteDisable();          // enable write protection
 
-  I2C_Write_Byte(RegAddr & 0xff);
-  I2C_Wait();
-  if((TWSR & 0xF8) != I2C_FLAG_DATA_TX_ACK_OK)
-    return I2C_Error(ERROR_EEPROM_WRITE_NO_DATA_ACK_RECEIVED);
+  return TRUE;
+}
 
-  while(len--)
-  {
-    I2C_Write_Byte( *data++ );
-    I2C_Wait();
-    if((TWSR & 0xF8) != I2C_FLAG_DATA_TX_ACK_OK)
-      return I2C_Error(ERROR_EEPROM_WRITE_NO_DATA_ACK_RECEIVED);
-  }
 
-  I2C_SendStop();
-  while(!(1<<TWSTO));
 
-  EepromWriteDisable();          // enable write protection
-  Sleep(10);                     // wait till all data is written (see datasheet)
+/////////////////////////////////////////////////////////////////////////
+// function : wait till the external EEPROM finished its write-cycle   //
+//            -> ACK-polling : device doesn't ACK its address while    //
+//               the data is written (see datasheet "ack polling")     //
+// given    : device-address of the written segment                    //
+// return   : TRUE if ready - FALSE if timeout                         //
+/////////////////////////////////////////////////////////////////////////
+WORD EEPROM_WaitWriteCycle(BYTE dev)
+{
+  BYTE timeout = EXT_EEPROM_WRITE_TIMEOUT;
+  BYTE status;
 
-  return TRUE;
+  ClearEvent(EVENT_1MS_TICK);
+  while(timeout > 0)
+  {
+    status = I2C_Probe(dev);               // EEPROM ACKs when write-cycle is done
+    if(status == I2C_JOB_DONE)
+      return TRUE;
+
+    if(status == I2C_JOB_NO_STARTCOND)
+      return I2C_Error(ERROR_EEPROM_WRITE_NO_STARTCOND_SENT);
+
+    if(IsEventPending(EVENT_1MS_TICK))
+    {
+      ClearEvent(EVENT_1MS_TICK);
+      timeout--;
+    }
+  }
+
+  return I2C_Error(ERROR_EEPROM_WRITE_TIMEOUT);
 }
 
 
@@ -236,90 +439,208 @@ WORD EEPROM_Bulk_Write_Page(WORD RegAddr, BYTE len, BYTE* data)
 //            data    = target-dataspace                               //
 // return   : nothing                                                  //
 /////////////////////////////////////////////////////////////////////////
-WORD EEPROM_Bulk_Read(WORD RegAddr, BYTE len, BYTE *data)
+WORD EEPROM_Bulk_Read(LONG RegAddr, BYTE len, BYTE *data)
 {
-   I2C_SendStart();
-   I2C_Wait();
-   if((TWSR & 0xF8) != I2C_FLAG_START)
-     return I2C_Error(ERROR_EEPROM_READ_NO_STARTCOND_SENT);
+   return I2C_Transfer(EEPROM_DeviceAddr(RegAddr), I2C_JOB_REG16 | I2C_JOB_READ, (WORD)RegAddr,
+                       len, data, ERROR_EEPROM_READ_NO_STARTCOND_SENT);
+}
 
-   I2C_Write_Byte(HW_ADDRESS_EEPROM);
-   I2C_Wait();
-   if((TWSR & 0xF8) != I2C_FLAG_ADDR_TX_ACK_OK)
-     return I2C_Error(ERROR_EEPROM_READ_NO_ADDR_ACK_RECEIVED);
 
-   I2C_Write_Byte(RegAddr >> 8);
-   I2C_Wait();
-   if((TWSR & 0xF8) != I2C_FLAG_DATA_TX_ACK_OK)
-     return I2C_Error(ERROR_EEPROM_READ_NO_DATA_ACK_RECEIVED);
 
-   I2C_Write_Byte(RegAddr & 0xff);
-   I2C_Wait();
-   if((TWSR & 0xF8) != I2C_FLAG_DATA_TX_ACK_OK)
-     return I2C_Error(ERROR_EEPROM_READ_NO_DATA_ACK_RECEIVED);
+/////////////////////////////////////////////////////////////////////////
+// function : start reading a chunk of the external EEPROM in the      //
+//            background -> EEPROM_Stream_Read() takes the bytes       //
+//            a chunk doesn't cross the end of a segment               //
+// given    : RegAddr = address of the first byte                      //
+// return   : TRUE, FALSE                                              //
+/////////////////////////////////////////////////////////////////////////
+WORD EEPROM_Stream_Open(LONG RegAddr)
+{
+   WORD rest = (WORD)(0x10000L - (RegAddr & 0xFFFF));   // bytes till end of segment
 
-   I2C_SendStart();
-   I2C_Wait();
-   if((TWSR & 0xF8) != I2C_FLAG_START_REPEATED)
-     return I2C_Error(ERROR_EEPROM_READ_NO_STARTCOND_SENT);
+   EEPROM_Stream_Close();                           // read-ahead of an other address is dropped
+
+   EepromStream.Addr = RegAddr;
+   EepromStream.Len  = (rest < EEPROM_STREAM_CHUNK) ? (BYTE)rest : EEPROM_STREAM_CHUNK;
+   EepromStream.Open = TRUE;
+
+   EepromStream.Job.Dev     = EEPROM_DeviceAddr(RegAddr);
+   EepromStream.Job.Flags   = I2C_JOB_REG16 | I2C_JOB_READ;
+   EepromStream.Job.RegAddr = (WORD)RegAddr;
+   EepromStream.Job.Len     = EepromStream.Len;
+   EepromStream.Job.Data    = &EepromStream.Buf[0];
+   EepromStream.Job.Work    = WORK_NO_WORK;
+
+   return I2C_Submit(&EepromStream.Job);
+}
 
-   I2C_Write_Byte( HW_ADDRESS_EEPROM | 0x01 );
-   I2C_Wait();
-   if((TWSR & 0xF8) != I2C_FLAG_ADDR_TX_AGAIN_ACK_OK)
-     return I2C_Error(ERROR_EEPROM_READ_NO_ADDR_ACK_AGAIN_RECEIVED);
 
-   while(len > 1)
+
+/////////////////////////////////////////////////////////////////////////
+// function : read bytes of the external EEPROM sequentially           //
+//            -> the next chunk is read by the TWI-interrupt while the //
+//               caller works on the bytes of the current one          //
+// given    : RegAddr = address of the first byte                      //
+//            len     = number of bytes                                //
+//            data    = target-dataspace                               //
+// return   : TRUE, FALSE                                              //
+/////////////////////////////////////////////////////////////////////////
+WORD EEPROM_Stream_Read(LONG RegAddr, BYTE len, BYTE *data)
+{
+   while(len > 0)
    {
-      I2C_Read_Byte(ACK);
-      I2C_Wait();
-      *data++ = TWDR;
+      if(!EepromStream.Open || (RegAddr < EepromStream.Addr) ||
+         (RegAddr >= (EepromStream.Addr + EepromStream.Len)))
+        EEPROM_Stream_Open(RegAddr);                // jump -> read the chunk at once
+
+      I2C_WaitJob(&EepromStream.Job);
+      if(EepromStream.Job.Status != I2C_JOB_DONE)
+      {
+        EepromStream.Open = FALSE;
+        return I2C_Error(ERROR_EEPROM_READ_NO_STARTCOND_SENT + EepromStream.Job.Status - I2C_JOB_NO_STARTCOND);
+      }
+
+      *data++ = EepromStream.Buf[(BYTE)(RegAddr - EepromStream.Addr)];
+      RegAddr++;
       len--;
+
+      if((RegAddr == (EepromStream.Addr + EepromStream.Len)) && (RegAddr < ExtEeprom.Size))
+        EEPROM_Stream_Open(RegAddr);                // chunk used -> read ahead the next one
    }
 
-   I2C_Read_Byte(NACK);
-   I2C_Wait();
-   *data = TWDR;
+   return TRUE;
+}
 
-   I2C_SendStop();
-   _delay_us(5);
 
-   return TRUE;
+
+/////////////////////////////////////////////////////////////////////////
+// function : drop the bytes read ahead of the external EEPROM         //
+//            -> a running read-ahead is finished first                //
+// given    : nothing                                                  //
+// return   : nothing                                                  //
+/////////////////////////////////////////////////////////////////////////
+void EEPROM_Stream_Close(void)
+{
+   if(!EepromStream.Open)
+     return;
+
+   I2C_WaitJob(&EepromStream.Job);
+   EepromStream.Open = FALSE;
 }
 
 
 
 /////////////////////////////////////////////////////////////////////////
-// function : write data to external temperature sensor (alerts, ...)  //
-// given    : RegAddr = address where data should be written           //
-//            data    = data                                           //
+// function : check if a segment of the external EEPROM is assembled   //
+// given    : number of segment                                        //
+// return   : TRUE if device ACKs its address                          //
+/////////////////////////////////////////////////////////////////////////
+BYTE EEPROM_Probe(BYTE seg)
+{
+   BYTE status;
+
+   status = I2C_Probe(EepromSegmentAddr[seg]);
+   if(status == I2C_JOB_NO_STARTCOND)
+     return I2C_Error(ERROR_EEPROM_READ_NO_STARTCOND_SENT);
+
+   return (status == I2C_JOB_DONE);                    // no ACK -> not assembled, no error
+}
+
+
+
+/////////////////////////////////////////////////////////////////////////
+// function : detect size of one segment by the address-wrap           //
+//            -> a device of x bytes ignores the address-bits above x  //
+//               so address x shows the same bytes as address 0        //
+//            -> read-only, a cell is written only if address 0 is     //
+//               blank (all bytes equal) -> no log or index to lose    //
+// given    : number of segment                                        //
+// return   : bytes of the segment                                     //
+/////////////////////////////////////////////////////////////////////////
+LONG EEPROM_GetSegmentSize(BYTE seg)
+{
+   LONG base = ((LONG)seg << 16);
+   LONG size;
+   BYTE first[EXT_EEPROM_WRAP_TEST_LEN];
+   BYTE probe[EXT_EEPROM_WRAP_TEST_LEN];
+   BYTE i, inv;
+
+   EEPROM_Bulk_Read(base, EXT_EEPROM_WRAP_TEST_LEN, &first[0]);
+
+   for(size=EXT_EEPROM_MIN_SIZE; size<0x10000; size<<=1)
+   {
+      EEPROM_Bulk_Read(base + size, EXT_EEPROM_WRAP_TEST_LEN, &probe[0]);
+      if(memcmp(&first[0], &probe[0], EXT_EEPROM_WRAP_TEST_LEN) != 0)
+        continue;                                   // different content -> no wrap
+
+      for(i=1; i<EXT_EEPROM_WRAP_TEST_LEN; i++)
+      {
+        if(first[i] != first[0])
+          return size;                              // same data at 0 and x -> wrapped
+      }
+
+      // blank device -> equal content says nothing, test by writing one cell
+      inv = ~probe[0];
+      EEPROM_Bulk_Write_Page(base + size, 1, &inv);
+      EEPROM_Bulk_Read(base, 1, &probe[1]);
+      EEPROM_Bulk_Write_Page(base + size, 1, &probe[0]);   // restore cell
+
+      if(probe[1] == inv)                           // cell 0 changed -> wrapped
+        return size;
+   }
+
+   return 0x10000;
+}
+
+
+
+/////////////////////////////////////////////////////////////////////////
+// function : detect assembled segments, size and page-size of the     //
+//            external EEPROM -> segments are used till the first one  //
+//            smaller than 64kB                                        //
+// given    : nothing                                                  //
 // return   : nothing                                                  //
 /////////////////////////////////////////////////////////////////////////
-WORD LM75_Write(BYTE RegAddr, BYTE data)
+void InitExtEeprom(void)
 {
-   I2C_SendStart();
-   I2C_Wait();
-   if((TWSR & 0xF8) != I2C_FLAG_START)
-     return I2C_Error(ERROR_EEPROM_WRITE_NO_STARTCOND_SENT);
+   BYTE seg;
+   LONG size;
 
-   I2C_Write_Byte(HW_ADDRESS_LM75);
-   I2C_Wait();
-   if((TWSR & 0xF8) != I2C_FLAG_ADDR_TX_ACK_OK)
-     return I2C_Error(ERROR_BOARDTEMP_WRITE_NO_ADDR_ACK_RECEIVED);
+   ExtEeprom.Size        = 0;
+   ExtEeprom.NumSegments = 0;
+   ExtEeprom.PageSize    = EXT_EEPROM_MIN_PAGE_SIZE;   // safe till size is known
 
-   I2C_Write_Byte(RegAddr);
-   I2C_Wait();
-   if((TWSR & 0xF8) != I2C_FLAG_DATA_TX_ACK_OK)
-     return I2C_Error(ERROR_BOARDTEMP_WRITE_NO_DATA_ACK_RECEIVED);
+   for(seg=0; seg<EXT_EEPROM_MAX_SEGMENTS; seg++)
+   {
+      if(!EEPROM_Probe(seg))
+        break;
 
-   I2C_Write_Byte(data);
-   I2C_Wait();
-   if((TWSR & 0xF8) != I2C_FLAG_DATA_TX_ACK_OK)
-     return I2C_Error(ERROR_BOARDTEMP_WRITE_NO_DATA_ACK_RECEIVED);
+      size = EEPROM_GetSegmentSize(seg);
+      ExtEeprom.Size += size;
+      ExtEeprom.NumSegments++;
 
-   I2C_SendStop();
-   while(!(1<<TWSTO));
+      if(size < 0x10000)                            // addresses not contiguous any more
+        break;
+   }
 
-   return TRUE;
+   if(ExtEeprom.Size > 0x8000)                      // 24C512 and larger
+     ExtEeprom.PageSize = EXT_EEPROM_MAX_PAGE_SIZE;
+   else if(ExtEeprom.Size > 0x2000)                 // 24C128/256
+     ExtEeprom.PageSize = 64;
+}
+
+
+
+/////////////////////////////////////////////////////////////////////////
+// function : write data to external temperature sensor (alerts, ...)  //
+// given    : RegAddr = address where data should be written           //
+//            data    = data                                           //
+// return   : nothing                                                  //
+/////////////////////////////////////////////////////////////////////////
+WORD LM75_Write(BYTE RegAddr, BYTE data)
+{
+   return I2C_Transfer(HW_ADDRESS_LM75, I2C_JOB_REG8, RegAddr, 1, &data,
+                       ERROR_BOARDTEMP_WRITE_NO_STARTCOND_SENT);
 }
 
 
@@ -331,42 +652,13 @@ WORD LM75_Write(BYTE RegAddr, BYTE data)
 /////////////////////////////////////////////////////////////////////////
 WORD LM75_Read(BYTE RegAddr)
 {
-   WORD data;
-
-   I2C_SendStart();
-   I2C_Wait();
-   if((TWSR & 0xF8) != I2C_FLAG_START)
-     return I2C_Error(ERROR_BOARDTEMP_READ_NO_STARTCOND_SENT);
-
-   I2C_Write_Byte(HW_ADDRESS_LM75);
-   I2C_Wait();
-   if((TWSR & 0xF8) != I2C_FLAG_ADDR_TX_ACK_OK)
-     return I2C_Error(ERROR_BOARDTEMP_READ_NO_ADDR_ACK_RECEIVED);
-
-   I2C_Write_Byte(RegAddr);
-   I2C_Wait();
-   if((TWSR & 0xF8) != I2C_FLAG_DATA_TX_ACK_OK)
-     return I2C_Error(ERROR_BOARDTEMP_READ_NO_DATA_ACK_RECEIVED);
-
-   I2C_SendStart();
-   I2C_Wait();
-
-   I2C_Write_Byte(HW_ADDRESS_LM75 | 0x01);
-   I2C_Wait();
-   if((TWSR & 0xF8) != I2C_FLAG_ADDR_TX_AGAIN_ACK_OK)
-     return I2C_Error(ERROR_BOARDTEMP_READ_NO_ADDR_ACK_AGAIN_RECEIVED);
-
-   I2C_Read_Byte(ACK);
-   I2C_Wait();
-   data = TWDR;
-   data = data << 8;
-
-   I2C_Read_Byte(NACK);
-   I2C_Wait();
-   data |= TWDR;
-   I2C_SendStop();
-
-return data;
+   BYTE data[2];
+
+   if(!I2C_Transfer(HW_ADDRESS_LM75, I2C_JOB_REG8 | I2C_JOB_READ, RegAddr, 2, &data[0],
+                    ERROR_BOARDTEMP_READ_NO_STARTCOND_SENT))
+     return FALSE;
+
+return ((WORD)data[0] << 8) | data[1];
 }
 
 
@@ -380,35 +672,8 @@ return data;
 /////////////////////////////////////////////////////////////////////////
 WORD PCF8563_Bulk_Write(BYTE RegAddr, BYTE len, BYTE* data)
 {
-   I2C_SendStart();
-   I2C_Wait();
-   if((TWSR & 0xF8) != I2C_FLAG_START)
-     return I2C_Error(ERROR_RTC_WRITE_NO_STARTCOND_SENT);
-
-   I2C_Write_Byte(HW_ADDRESS_PCF8563_WRITE);
-   I2C_Wait();
-   if((TWSR & 0xF8) != I2C_FLAG_ADDR_TX_ACK_OK)
-     return I2C_Error(ERROR_RTC_WRITE_NO_ADDR_ACK_RECEIVED);
-
-   I2C_Write_Byte(RegAddr);
-   I2C_Wait();
-   if((TWSR & 0xF8) != I2C_FLAG_DATA_TX_ACK_OK)
-     return I2C_Error(ERROR_RTC_WRITE_NO_DATA_ACK_RECEIVED);
-
-   while(len)
-   {
-      I2C_Write_Byte( *data++ );
-      I2C_Wait();
-      if((TWSR & 0xF8) != I2C_FLAG_DATA_TX_ACK_OK)
-        return I2C_Error(ERROR_RTC_WRITE_NO_DATA_ACK_RECEIVED);
-
-      len--;
-   }
-
-   I2C_SendStop();
-   while(!(1<<TWSTO));
-
-   return TRUE;
+   return I2C_Transfer(HW_ADDRESS_PCF8563_WRITE, I2C_JOB_REG8, RegAddr, len, data,
+                       ERROR_RTC_WRITE_NO_STARTCOND_SENT);
 }
 
 
@@ -422,44 +687,8 @@ WORD PCF8563_Bulk_Write(BYTE RegAddr, BYTE len, BYTE* data)
 /////////////////////////////////////////////////////////////////////////
 WORD PCF8563_Bulk_Read(BYTE RegAddr, BYTE len, BYTE *data)
 {
-   I2C_SendStart();                              // set startcondition
- 	 I2C_Wait();
-   if((TWSR & 0xF8) != I2C_FLAG_START)
-     return I2C_Error(ERROR_RTC_READ_NO_STARTCOND_SENT);
-
- 	 I2C_Write_Byte(HW_ADDRESS_PCF8563_WRITE);     // write address of RTC
-	 I2C_Wait();
-    if((TWSR & 0xF8) != I2C_FLAG_ADDR_TX_ACK_OK)
-      return I2C_Error(ERROR_RTC_READ_NO_ADDR_ACK_RECEIVED);
-
-	 I2C_Write_Byte(RegAddr);                      // set index of selected register
-	 I2C_Wait();
-    if((TWSR & 0xF8) != I2C_FLAG_DATA_TX_ACK_OK)
-      return I2C_Error(ERROR_RTC_READ_NO_DATA_ACK_RECEIVED);
-
-	 I2C_SendStart();                              // set startcondition again
-	 I2C_Wait();
-
-	 I2C_Write_Byte(HW_ADDRESS_PCF8563_READ);      // write address of RTC
-	 I2C_Wait();
-    if((TWSR & 0xF8) != I2C_FLAG_ADDR_TX_AGAIN_ACK_OK)
-      return I2C_Error(ERROR_RTC_READ_NO_ADDR_ACK_AGAIN_RECEIVED);
-
-	 while(len > 1)                                // receive databytes
-	 {
-	 	 I2C_Read_Byte(ACK);
-		 I2C_Wait();
-		 *data++ = TWDR;
-		 len--;
-	 }
-
-	 I2C_Read_Byte(NACK);                          // read last byte with no ACK
-	 I2C_Wait();
-	 *data = TWDR;
-
-	 I2C_SendStop();
-
-   return TRUE;
+   return I2C_Transfer(HW_ADDRESS_PCF8563_WRITE, I2C_JOB_REG8 | I2C_JOB_READ, RegAddr, len, data,
+                       ERROR_RTC_READ_NO_STARTCOND_SENT);
 }
 
 
@@ -488,6 +717,7 @@ BYTE tmp = 0x00;
 
 /////////////////////////////////////////////////////////////////////////
 // function : safe given errorcode to internal EEPROM                  //
+//            -> the failed job was already stopped by I2C_Finish()    //
 // given    : error = contains given errorcode where failure happens   //
 // return   : nothing                                                  //
 /////////////////////////////////////////////////////////////////////////
@@ -495,9 +725,6 @@ WORD I2C_Error(WORD error)
 {
   EepromWriteDisable();          // enable write protection
 
-  I2C_SendStop();
-  I2C_DisableI2C();
-
   SafeErrorsToEEPROM(error);
 
 return FALSE;
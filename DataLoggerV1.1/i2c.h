@@ -5,7 +5,15 @@
 #define  HW_ADDRESS_LM75            0x90
 #define  HW_ADDRESS_PCF8563_READ    0xA3
 #define  HW_ADDRESS_PCF8563_WRITE   0xA2
-#define  HW_ADDRESS_EEPROM          0xA0
+#define  HW_ADDRESS_EEPROM          0xA0    // 1st segment, further segments -> see i2c.c
+
+#define  EXT_EEPROM_MAX_SEGMENTS    4       // 64kB each, strapped by A1/A2 -> A0 = 0 (0xA2 is the RTC)
+#define  EXT_EEPROM_MIN_SIZE        0x1000  // 24C32
+#define  EXT_EEPROM_MIN_PAGE_SIZE   32      // 24C32/64
+#define  EXT_EEPROM_MAX_PAGE_SIZE   128     // 24C512
+#define  EXT_EEPROM_WRITE_TIMEOUT   20      // ms -> max write-cycle is 10ms (see datasheet)
+#define  EXT_EEPROM_WRAP_TEST_LEN   16      // bytes compared at address 0 and x for the size-detection
+#define  EEPROM_STREAM_CHUNK        64      // bytes read ahead by EEPROM_Stream_Read() -> 5 bytes set-up per chunk
 
 #define  ACK      1
 #define  NACK     0
@@ -15,14 +23,37 @@
 #define  I2C_FLAG_ADDR_TX_ACK_OK        0x18
 #define  I2C_FLAG_NO_ADDR_TX_ACK        0x20
 #define  I2C_FLAG_DATA_TX_ACK_OK        0x28
+#define  I2C_FLAG_NO_DATA_TX_ACK        0x30
 #define  I2C_FLAG_ADDR_TX_AGAIN_ACK_OK  0x40
+#define  I2C_FLAG_NO_ADDR_TX_AGAIN_ACK  0x48
+#define  I2C_FLAG_DATA_RX_ACK           0x50
+#define  I2C_FLAG_DATA_RX_NACK          0x58
+
+#define  I2C_QUEUE_SIZE                 4       //valid = 2,4,8,16
+
+// flags of a job -> the low bits are the bytes of the register-address
+#define  I2C_JOB_REG8                   0x01
+#define  I2C_JOB_REG16                  0x02
+#define  I2C_JOB_READ                   0x80    // data is read after a repeated start
+
+// status of a job -> errorcodes of a device follow this order
+#define  I2C_JOB_DONE                   0x00
+#define  I2C_JOB_NO_STARTCOND           0x01
+#define  I2C_JOB_NO_ADDR_ACK            0x02
+#define  I2C_JOB_NO_DATA_ACK            0x03
+#define  I2C_JOB_NO_ADDR_ACK_AGAIN      0x04
+#define  I2C_JOB_PENDING                0xFF
 
+#define  I2C_CTRL_START     ((1<<TWINT) | (1<<TWSTA) | (1<<TWEN) | (1<<TWIE))
+#define  I2C_CTRL_NEXT      ((1<<TWINT) | (1<<TWEN) | (1<<TWIE))
+#define  I2C_CTRL_NEXT_ACK  ((1<<TWINT) | (1<<TWEA) | (1<<TWEN) | (1<<TWIE))
+#define  I2C_CTRL_STOP      ((1<<TWINT) | (1<<TWSTO) | (1<<TWEN))
 
 
-#define  I2C_SendStart()    (TWCR |= ((1<<TWINT) | (1<<TWSTA) | (1<<TWEN)) )
 #define  I2C_SendStop()     (TWCR |= ((1<<TWINT) | (1<<TWSTO) | (1<<TWEN)) )
-#define  I2C_Wait()         while(! (TWCR & (1<<TWINT)) )
+#define  I2C_WaitStop()     while(TWCR & (1<<TWSTO))
 #define  I2C_DisableI2C()   TWCR = 0x00
+#define  IsI2C_Busy()       (TwiEngine.Head != TwiEngine.Tail)
 
 
 #define  RTC_TIMER_SEC     0x02
@@ -35,7 +66,49 @@ typedef struct
 } s_timestamp;
 
 
+typedef struct
+{
+   LONG  Size;             // bytes of all segments -> 0 = no EEPROM
+   BYTE  PageSize;         // bytes of one page-write
+   BYTE  NumSegments;      // number of 64kB device-addresses
+} s_ext_eeprom;
+
+
+typedef struct
+{
+   BYTE           Dev;        // device-address for writing
+   BYTE           Flags;      // I2C_JOB_xxx
+   WORD           RegAddr;    // sent MSB first
+   BYTE           Len;        // bytes of data, >0 for reading
+   BYTE*          Data;
+   BYTE           Work;       // posted when the job is finished, WORK_NO_WORK = none
+   volatile BYTE  Status;     // I2C_JOB_PENDING till the TWI-interrupt finished the job
+} s_i2c_job;
+
+
+typedef struct
+{
+   s_i2c_job*     Queue[I2C_QUEUE_SIZE];
+   volatile BYTE  Head;       // written by I2C_Submit()
+   volatile BYTE  Tail;       // job executed by the TWI-interrupt
+   BYTE           Pos;        // byte of the register-address or data
+} s_twi_engine;
+
+
+typedef struct
+{
+   LONG       Addr;           // address of Buf[0]
+   BYTE       Len;            // bytes read into Buf
+   BYTE       Open;           // TRUE if Buf is valid or read ahead by Job
+   BYTE       Buf[EEPROM_STREAM_CHUNK];
+   s_i2c_job  Job;
+} s_eeprom_stream;
+
+
 extern s_timestamp    CodedTimestamp;
+extern s_ext_eeprom   ExtEeprom;
+extern s_eeprom_stream  EepromStream;
+extern s_twi_engine   TwiEngine;
 
 
 
@@ -44,9 +117,17 @@ extern s_timestamp    CodedTimestamp;
 
 // prototypes
 
-void I2C_Write_Byte(BYTE data);
+BYTE I2C_Submit(s_i2c_job* job);
+
+void I2C_WaitJob(s_i2c_job* job);
 
-void I2C_Read_Byte(BYTE ack);
+void I2C_NextStep(void);
+
+void I2C_Finish(BYTE status);
+
+WORD I2C_Transfer(BYTE dev, BYTE flags, WORD RegAddr, BYTE len, BYTE* data, WORD error);
+
+BYTE I2C_Probe(BYTE dev);
 
 void ReadRTC(void);
 
@@ -63,16 +144,25 @@ void StartAlarmTimer(void);
 void ReadOnboardTemp(void);
 
 
-//inline void I2C_Write_Byte(BYTE data);
+WORD EEPROM_Bulk_Write(LONG RegAddr, BYTE len, BYTE* data);
+
+WORD EEPROM_Bulk_Write_Page(LONG RegAddr, BYTE len, BYTE* data);
+
+WORD EEPROM_Bulk_Read(LONG RegAddr, BYTE len, BYTE *data);
+
+WORD EEPROM_WaitWriteCycle(BYTE dev);
+
+WORD EEPROM_Stream_Open(LONG RegAddr);
 
-//inline void I2C_Read_Byte(BYTE ack);
+WORD EEPROM_Stream_Read(LONG RegAddr, BYTE len, BYTE *data);
 
+void EEPROM_Stream_Close(void);
 
-WORD EEPROM_Bulk_Write(WORD RegAddr, BYTE len, BYTE* data);
+BYTE EEPROM_Probe(BYTE seg);
 
-WORD EEPROM_Bulk_Write_Page(WORD RegAddr, BYTE len, BYTE* data);
+LONG EEPROM_GetSegmentSize(BYTE seg);
 
-WORD EEPROM_Bulk_Read(WORD RegAddr, BYTE len, BYTE *data);
+void InitExtEeprom(void);
 
 
 WORD LM75_Write(BYTE RegAddr, BYTE data);
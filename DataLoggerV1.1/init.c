@@ -65,9 +65,9 @@ void SafeSensorConfig(void)
 /////////////////////////////////////////////////////////////////////////
 void InitTimer0 (void)
 {
-   TCCR0 = 0x02;            // prescale clock by 8 -> 1.8432MHz / 8
-   TCNT0 = 0xFF - 230;
-   OCR0  = 0xFF - 230 - 2;  // to prevent output-compare-int-flag
+   TCCR0 = 0x0A;            // CTC-mode, prescale clock by 8 -> 1.8432MHz / 8
+   TCNT0 = 0x00;
+   OCR0  = TIMER0_OCR_1MS_LONG;
 }
 
 
@@ -85,13 +85,21 @@ void InitTimer1 (void)
 
 
 /////////////////////////////////////////////////////////////////////////
-// function : init timer2                                              //
+// function : init timer2 -> async counter of impulses at TOSC1 (PC6)  //
 // given    : nothing                                                  //
 // return   : nothing                                                  //
 /////////////////////////////////////////////////////////////////////////
 void InitTimer2 (void)
 {
-
+#ifdef IMPULSE_INPUT_HW_COUNTER
+   ASSR  = 0x08;            // async-mode -> clocked by TOSC1-pin, PC7 (TOSC2) is lost -> see main.h
+   TCNT2 = 0x00;
+   TCCR2 = 0x01;            // normal-mode, no prescaler -> count every edge
+   while(ASSR & 0x07);      // wait till registers are updated
+   TIFR  = 0x40;            // clear overflow-flag
+
+   Sensor.Impulse.LastCount = 0x00;
+#endif
 }
 
 
@@ -103,7 +111,9 @@ void InitTimer2 (void)
 /////////////////////////////////////////////////////////////////////////
 void InitADC (void)
 {
-
+   ADCSRA = 0x00;           // ADC is powered up on request -> ADC_RequestConversion()
+   ADMUX  = 0x00;
+   memset(&Adc, 0x00, sizeof(Adc));
 }
 
 
@@ -125,18 +135,28 @@ void InitI2C (void)
 
 
 /////////////////////////////////////////////////////////////////////////
-// function : init internal UART with 9600 or 115200 baud              //
+// function : init internal UART with 9600, 115200 or 230400 baud      //
 // given    : baudrate                                                 //
 // return   : nothing                                                  //
 /////////////////////////////////////////////////////////////////////////
 void InitUART (BYTE baudrate)
 {
 
+   USB_WaitTxDone();  // send queued bytes with the old baudrate
+
    UCSRB = 0x00;      // disable uart
+   USB.TxRing.Tail = USB.TxRing.Head;   // drop bytes not sent
    UBRRH = 0x00;
 
+   UCSRA = 0x00;      // normal speed, FE/DOR/PE have to be written 0 -> no read-modify-write
+
    if(baudrate == BAUDRATE_9600)
       UBRRL = 11;     // 9600 baud
+   else if(baudrate == BAUDRATE_230400)
+   {
+      UCSRA = UART_U2X;
+      UBRRL = 0;      // 230400 baud -> double-speed
+   }
    else
       UBRRL = 0;      // 115200 baud
 
@@ -179,6 +199,8 @@ void InitHW (void)
    SPCR    = 0x00;      // no spi
    SPSR    = 0x00;
 
+   ACSR    = 0x80;      // disable analog comparator -> saves power in sleepmodes
+
    TWBR    = 0x00;      // clear I2C baudrate
    TWCR    = 0x00;      // clear I2C interrupt-flags
 }
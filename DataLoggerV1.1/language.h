@@ -53,6 +53,7 @@
 #define STRING_SET_SENSOR_NOT_SET           f_str("not set")
 
 #define STRING_SET_SENSOR_INTERVAL          f_str("measure interval")
+#define STRING_MENU_ALIGN_INTERVALS         "align intervals"
 
 
 #define STRING_MENU_SENSOR_IMPULSE          f_str(">impulse input")
@@ -68,7 +69,7 @@
 
 // display-msg : "safe data to usb-stick"
 #define STRING_SAFE_DATA_TO_STICK1          f_str("safe sensordata")
-#define STRING_SAFE_DATA_TO_STICK2          f_str(" to USB-stick...")
+#define STRING_SAFE_DATA_TO_STICK2          f_str(" to USB")
 
 
 // text for display error logging
@@ -131,6 +132,7 @@
 #define STRING_SET_SENSOR_NOT_SET           f_str("nicht konfiguriert")
 
 #define STRING_SET_SENSOR_INTERVAL          f_str("setze Interval")
+#define STRING_MENU_ALIGN_INTERVALS         "Intervall synch"
 
 #define STRING_MENU_SENSOR_IMPULSE          f_str(">Impuls Eingang")
 #define STRING_MENU_SENSOR_0_10VDC          f_str(">0...10VDC     ")
@@ -144,7 +146,7 @@
 
 // display-msg : "safe data to usb-stick"
 #define STRING_SAFE_DATA_TO_STICK1          f_str("Sensordaten auf")
-#define STRING_SAFE_DATA_TO_STICK2          f_str("USB sichern ...")
+#define STRING_SAFE_DATA_TO_STICK2          f_str("USB sichern")
 
 
 // text zur anzeige der fehler-aufzeichung
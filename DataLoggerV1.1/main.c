@@ -23,6 +23,7 @@ int main (void)
 {
   InitHW();
   InitTimer0();           // systemtimer with 1ms slot
+  InitTimer2();           // hardware impulse-counter
   InitADC();
   InitI2C();
   InstallInterrupts();    
@@ -42,24 +43,30 @@ int main (void)
 
 /////////////////////////////////////////////////////////////////////////
 // function : timer interrupt 0 -> systemtimer : called every 1ms      //
+//            timer runs in CTC-mode -> no reload, no drift by latency //
 // given    : nothing                                                  //
 // return   : nothing                                                  //
 /////////////////////////////////////////////////////////////////////////
-ISR(TIMER0_OVF_vect)
+ISR(TIMER0_COMP_vect)
 {
-  TCNT0 = 0xFF - 230;         // reload time for 1ms timetick
-  if(TIFR & 0x02)             // this int-routine was blocked by other INT's
-    TIFR |= 0x02;
-
   SetEvent(EVENT_1MS_TICK);
 
-  if(System.msTimer++ > 999)  // increment systemtimer
+  if(++System.msTimer > 999)  // increment systemtimer
   {
     System.msTimer = 0;
     System.secTimer++;
-    SensorServiceFast();      // check if a fast-service is necessary
+    if(System.ClockTicks < 0xFFFF)     // added to System.Time by UpdateSystemClock()
+      System.ClockTicks++;
+    SensorServiceFast();                  // request samples -> stored by the ADC-interrupt
+    PostWork(WORK_USB_SESSION_SERVICE);   // power-off of an idle uALFAT is done by Application()
   }
 
+  // 230.4 counts per ms -> mix long and short periods for an exact second
+  if(System.msTimer < TIMER0_LONG_TICKS_PER_SEC)
+    OCR0 = TIMER0_OCR_1MS_LONG;
+  else
+    OCR0 = TIMER0_OCR_1MS_SHORT;
+
   if(System.callbackTimer > 0)        // service callbacktimer
   { 
     System.callbackTimer--;
@@ -75,6 +82,20 @@ ISR(TIMER0_OVF_vect)
 
 
 
+#ifdef IMPULSE_INPUT_HW_COUNTER
+/////////////////////////////////////////////////////////////////////////
+// function : timer interrupt 2 -> 256 impulses counted by hardware    //
+// given    : nothing                                                  //
+// return   : nothing                                                  //
+/////////////////////////////////////////////////////////////////////////
+ISR(TIMER2_OVF_vect)
+{
+  ImpulseCounterOverflow();
+}
+#endif
+
+
+
 /////////////////////////////////////////////////////////////////////////
 // function : if box is opened or closed this function is called(INT0) //
 // given    : nothing                                                  //
@@ -101,7 +122,6 @@ ISR(INT1_vect)
 {
   // wakeup system
   DisableRTC_Int();
-  PowerSaveModeDisable();
   SetEvent(EVENT_RTC_INTERRUPT);
 }
 
@@ -119,6 +139,42 @@ ISR(USART_RXC_vect)
 
 
 
+/////////////////////////////////////////////////////////////////////////
+// function : uart data register empty interrupt                       //
+// given    : nothing                                                  //
+// return   : nothing                                                  //
+/////////////////////////////////////////////////////////////////////////
+ISR(USART_UDRE_vect)
+{
+  TransmitUSB_NextByte();
+}
+
+
+
+/////////////////////////////////////////////////////////////////////////
+// function : TWI interrupt -> next step of the running I2C-job        //
+// given    : nothing                                                  //
+// return   : nothing                                                  //
+/////////////////////////////////////////////////////////////////////////
+ISR(TWI_vect)
+{
+  I2C_NextStep();
+}
+
+
+
+/////////////////////////////////////////////////////////////////////////
+// function : ADC conversion complete interrupt                        //
+// given    : nothing                                                  //
+// return   : nothing                                                  //
+/////////////////////////////////////////////////////////////////////////
+ISR(ADC_vect)
+{
+  ADC_ConversionComplete();
+}
+
+
+
 /////////////////////////////////////////////////////////////////////////
 // function : install all interal an external int-requests             //
 // given    : nothing                                                  //
@@ -130,7 +186,10 @@ void InstallInterrupts(void)
   GICR  |=  0x40;         // enable external INT0
   GICR  |=  0x80;         // enable external INT1
   GIFR  &= ~0xE0;         // clear pending ext-int-flags
-  TIMSK  =  0x01;         // enable timer0 overflow-interrupt
+  TIMSK  =  0x02;         // enable timer0 compare-match-interrupt
+#ifdef IMPULSE_INPUT_HW_COUNTER
+  TIMSK |=  0x40;         // enable timer2 overflow-interrupt -> impulse-counter
+#endif
 }
 
 
@@ -140,12 +199,13 @@ void InstallInterrupts(void)
 // given    : mask of events, timeout in ms                            //
 // return   : event timeout, or given event received                   //
 /////////////////////////////////////////////////////////////////////////
-BYTE WaitEventTimeout (BYTE event, WORD timeout)
+BYTE WaitEventTimeout (WORD event, WORD timeout)
 {
   while(timeout--)
   {
     ClearEvent(EVENT_1MS_TICK);
-    while(!(System.EventID & (EVENT_1MS_TICK | event)));
+    while(!(System.EventID & (EVENT_1MS_TICK | event)))
+      WaitForInterrupt(EVENT_1MS_TICK | event);
     
     if(IsEventPending(event))      // if given event received -> return success
       return EVENT_RESULT_SUCCESS;
@@ -153,3 +213,172 @@ BYTE WaitEventTimeout (BYTE event, WORD timeout)
 
   return EVENT_RESULT_TIMEOUT;
 }
+
+
+
+/////////////////////////////////////////////////////////////////////////
+// function : check if someone needs the 1ms-systemtimer               //
+// given    : nothing                                                  //
+// return   : TRUE if the systemtimer has to run                       //
+/////////////////////////////////////////////////////////////////////////
+BYTE IsSystemTickRequired(void)
+{
+  if(IsBoxOpen()                ||    // keypad is scanned by the systemtimer
+     IsFastSamplingActive()     ||    // fast-service needs the systemtimer
+     IsUSB_SessionOpen()        ||    // idle-time of the uALFAT is counted by the systemtimer
+#ifndef IMPULSE_INPUT_HW_COUNTER
+     IsImpulseInputActive()     ||    // impulse-input is polled + debounced every 1ms
+#endif
+     (System.callbackTimer > 0))
+    return TRUE;
+
+  return FALSE;
+}
+
+
+
+/////////////////////////////////////////////////////////////////////////
+// function : correct msTimer/secTimer after the systemtimer was       //
+//            stopped -> elapsed time is taken from the external RTC   //
+// given    : epoch-seconds before the systemtimer was stopped          //
+// return   : nothing                                                  //
+/////////////////////////////////////////////////////////////////////////
+void ResyncSystemTimer(LONG stop_time)
+{
+  SyncSystemClock();                  // only the RTC was running while sleeping
+
+  if(System.Epoch > stop_time)        // epoch is continuous over month and year
+    MutexFunc(System.secTimer += (WORD)(System.Epoch - stop_time);)   // msTimer keeps its phase
+}
+
+
+
+/////////////////////////////////////////////////////////////////////////
+// function : sleep till the next interrupt if no event is pending     //
+//            power-down : nothing needs the systemtimer -> it is      //
+//                         stopped, wakeup by RTC (INT1) or box-switch //
+//                         (INT0), msTimer/secTimer are resynced by RTC//
+//            power-save : like power-down, timer2 counts impulses     //
+//            idle       : systemtimer, ADC or UART are still needed   //
+// given    : nothing                                                  //
+// return   : nothing                                                  //
+/////////////////////////////////////////////////////////////////////////
+void SystemSleep(void)
+{
+  BYTE mode = SLEEP_MODE_IDLE;
+  LONG stop_time = 0;
+
+  if(!IsSystemTickRequired() && (Adc.Pending == 0) && !IsUartTxPending() && !IsI2C_Busy())   // ADC, UART + TWI stop in power-down
+  {
+    mode = SLEEP_MODE_PWR_DOWN;
+#ifdef IMPULSE_INPUT_HW_COUNTER
+    if(IsImpulseInputActive())
+      mode = SLEEP_MODE_PWR_SAVE;     // keep async timer2 counting
+#endif
+    stop_time = GetSystemEpoch();
+  }
+
+  DisableGlobalInterrupt();
+  if((System.EventID & EVENT_APPLICATION_MASK) || (System.EventTimer != EVENT_TIMER_NO_TICK))
+  {
+    EnableGlobalInterrupt();          // something to do -> don't sleep
+    return;
+  }
+
+  if(mode != SLEEP_MODE_IDLE)
+  {
+    StopSystemTimer();
+    BoxSwitchIntOnLevel();            // only a level-int wakes from power-down
+  }
+
+  set_sleep_mode(mode);
+  sleep_enable();
+  EnableGlobalInterrupt();            // sleep is executed before a pending int
+  sleep_cpu();
+  sleep_disable();
+
+  if(mode != SLEEP_MODE_IDLE)
+  {
+    BoxSwitchIntOnChange();
+    ResyncSystemTimer(stop_time);
+    StartSystemTimer();
+  }
+}
+
+
+
+/////////////////////////////////////////////////////////////////////////
+// function : sleep in idle-mode till the next interrupt               //
+//            -> returns at once if the given event is already pending //
+// given    : mask of events                                           //
+// return   : nothing                                                  //
+/////////////////////////////////////////////////////////////////////////
+void WaitForInterrupt(WORD event)
+{
+  DisableGlobalInterrupt();
+  if(!(System.EventID & event))
+  {
+    set_sleep_mode(SLEEP_MODE_IDLE);
+    sleep_enable();
+    EnableGlobalInterrupt();          // sleep is executed before a pending int
+    sleep_cpu();
+    sleep_disable();
+  }
+  EnableGlobalInterrupt();
+}
+
+
+
+/////////////////////////////////////////////////////////////////////////
+// function : post a work-item to the deferred-work-queue -> the work  //
+//            is done later by Application() with interrupts enabled   //
+//            may be called from interrupts                            //
+// given    : id of work (WORK_xxx)                                    //
+// return   : TRUE if queued, FALSE if queue is full                   //
+/////////////////////////////////////////////////////////////////////////
+BYTE PostWork(BYTE id)
+{
+  BYTE head;
+  BYTE ret = FALSE;
+
+  GetMutex();
+  head = (System.Work.Head + 1) & (WORK_QUEUE_SIZE - 1);
+  if(head != System.Work.Tail)     // if queue full -> work is lost
+  {
+    System.Work.Item[System.Work.Head].ID        = id;
+    System.Work.Item[System.Work.Head].Timestamp = System.secTimer;
+    System.Work.Head = head;
+    System.EventID  |= EVENT_WORK_PENDING;
+    ret = TRUE;
+  }
+  else if(System.Work.Lost < 0xFF)
+    System.Work.Lost++;            // reported by Application()
+  ReleaseMutex();
+
+  return ret;
+}
+
+
+
+/////////////////////////////////////////////////////////////////////////
+// function : get oldest work-item of the deferred-work-queue          //
+// given    : pointer where the work-item is copied to                 //
+// return   : TRUE if work was copied, FALSE if queue is empty         //
+/////////////////////////////////////////////////////////////////////////
+BYTE GetWork(s_work* work)
+{
+  BYTE ret = FALSE;
+
+  GetMutex();
+  if(System.Work.Tail != System.Work.Head)
+  {
+    *work = System.Work.Item[System.Work.Tail];
+    System.Work.Tail = (System.Work.Tail + 1) & (WORK_QUEUE_SIZE - 1);
+    ret = TRUE;
+  }
+  else
+    System.EventID &= ~EVENT_WORK_PENDING;   // queue is empty
+  ReleaseMutex();
+
+  return ret;
+}
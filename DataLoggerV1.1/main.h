@@ -30,6 +30,7 @@ union union_l_b
 #include <avr/io.h>
 #include <avr/interrupt.h>
 #include <avr/pgmspace.h>
+#include <avr/sleep.h>
 #include <avr/wdt.h>
 #include <util/atomic.h>
 #include <util/delay.h>
@@ -53,8 +54,17 @@ union union_l_b
 #define  EVENT_RTC_INTERRUPT            0x20
 #define  EVENT_USB_MSG                  0x40
 #define  EVENT_IMPULSE_INPUT_TRIGGERED  0x80
+#define  EVENT_ADC_READY                0x0100
+#define  EVENT_WORK_PENDING             0x0200
+#define  EVENT_USB_EXPORT               0x0400      // logs are safed to USB-stick -> USB_LogSensorValuesStep()
+
+// events dispatched by Application() -> no sleep while one is pending
+#define  EVENT_APPLICATION_MASK         (EVENT_TIME_CALLBACK | EVENT_BOX_OPENED | EVENT_BOX_CLOSED | \
+                                         EVENT_KEY_CHANGED | EVENT_RTC_INTERRUPT | EVENT_IMPULSE_INPUT_TRIGGERED | \
+                                         EVENT_ADC_READY | EVENT_WORK_PENDING | EVENT_USB_EXPORT)
 
 #define  EVENT_CALLBACK_CLR_IMP_SIGNAL  0x01
+#define  EVENT_CALLBACK_START_MENU      0x02
 
 
 #define  EVENT_TIMER_NO_TICK            0x00
@@ -75,8 +85,17 @@ union union_l_b
 
 
 
+#define  WORK_NO_WORK                   0x00
+#define  WORK_USB_SESSION_SERVICE       0x01
+
+
 #define  MAX_USB_BUFFER_LEN             200
+#define  USB_TX_RING_SIZE               64      //valid = 2,4,8,16,32,64,128
+#define  USB_RX_RING_SIZE               128     //valid = 2,4,8,16,32,64,128
+#define  USB_RX_QUEUE_SIZE              8       //valid = 2,4,8,16,32
+#define  USB_RX_MSG_LEN                 48      // longer messages are cut by USB_PopRxMessage()
 #define  MAX_ERROR_LOGS                 127
+#define  WORK_QUEUE_SIZE                8       //valid = 2,4,8,16,32
 
 
 typedef struct
@@ -123,12 +142,58 @@ typedef struct
 } s_key;
 
 
+typedef struct
+{
+   BYTE  State;            // USB_EXPORT_xxx
+   BYTE  File[4];          // file open at uALFAT-handle 0..3, 0 = closed
+   BYTE  Age[4];           // calls since the handle was used last
+   BYTE  LastRec;          // last record of lines staged in USB.Tx
+   BYTE  LineStart;        // record of the line being built
+   LONG  Addr;             // next log-block to safe
+   LONG  Start;            // first log-block of the export -> progress
+   BYTE  Failed;           // TRUE = stopped at an unreadable block -> USB_EXPORT_ERROR
+} s_usb_export;
+
+
+typedef struct
+{
+   BYTE  Start;            // offset of the message in the rx-ring
+   BYTE  Len;              // length without uALFAT_EOT
+} s_rx_msg;
+
+
+typedef struct
+{
+   BYTE           Data[USB_RX_RING_SIZE];
+   volatile BYTE  Head;       // written by the RXC-interrupt
+   volatile BYTE  Tail;       // start of the oldest message not read
+   BYTE           MsgStart;   // start of the message being received
+   s_rx_msg       Queue[USB_RX_QUEUE_SIZE];
+   volatile BYTE  QueueHead;  // written by the RXC-interrupt
+   volatile BYTE  QueueTail;  // read by USB_PopRxMessage()
+   BYTE           Msg[USB_RX_MSG_LEN];    // message read last
+} s_rx_ring;
+
+
+typedef struct
+{
+   BYTE           Data[USB_TX_RING_SIZE];
+   volatile BYTE  Head;    // written by TransmitUSB_Byte()
+   volatile BYTE  Tail;    // read by the UDRE-interrupt
+   BYTE           Sending; // TRUE till USB_WaitTxDone()
+} s_tx_ring;
+
+
 typedef struct
 {
    CHAR           uALFAT_version[5];
-   BYTE           usb_init_done;
-   s_serial_buf   Rx;
+   BYTE           usb_init_done;   // uALFAT powered + stick mounted -> session open
+   BYTE           fast_log_open;   // "S_FAST.CSV" kept open while the session lasts
+   WORD           idle_time;       // System.secTimer of the last access
+   s_rx_ring      Rx;
    s_serial_buf   Tx;
+   s_tx_ring      TxRing;
+   s_usb_export   Export;
 } s_usb;
 
 
@@ -138,13 +203,32 @@ typedef struct
 } s_flags;
 
 
+typedef struct
+{
+   BYTE  ID;
+   WORD  Timestamp;        // System.secTimer when the work was posted
+} s_work;
+
+
+typedef struct
+{
+   s_work         Item[WORK_QUEUE_SIZE];
+   volatile BYTE  Head;    // written by interrupts
+   volatile BYTE  Tail;    // read by Application()
+   volatile BYTE  Lost;    // posts dropped because the queue was full
+} s_work_queue;
+
+
 typedef struct
 {
    WORD   msTimer;
    WORD   secTimer;
    WORD   callbackTimer;
+   volatile WORD ClockTicks;     // seconds not added to System.Epoch yet
+   WORD   ClockAge;              // seconds since System.Time was read from the RTC
+   LONG   Epoch;                 // seconds since 01.01.2000 00:00:00
 
-   volatile BYTE EventID;
+   volatile WORD EventID;
    volatile BYTE EventTimer;
    BYTE          EventMsg;
    BYTE          CallbackEvent;
@@ -153,6 +237,7 @@ typedef struct
    WORD          SupplyVoltage;
 
    s_flags       Flags;
+   s_work_queue  Work;
    s_key         Key;
    s_time        Time;
    s_timealert   Alert;
@@ -190,8 +275,11 @@ extern   s_usb             USB;
 #define  ClearTimerEvent(event)       MutexFunc((System.EventTimer &= ~(event));)
 
 
-#define  PowerSaveModeEnable()
-#define  PowerSaveModeDisable()
+#define  BoxSwitchIntOnLevel()        (MCUCR &= ~0x03)                  // INT0 at low-level -> wakes from power-down
+#define  BoxSwitchIntOnChange()       (MCUCR = (MCUCR & ~0x03) | 0x01)  // INT0 at any change on PD2
+
+#define  StopSystemTimer()            (TIMSK &= ~0x02)                  // no 1ms-tick while powered down
+#define  StartSystemTimer()           {TCNT0 = 0x00; TIFR = 0x02; TIMSK |= 0x02;}
 
 #define  DisableRTC_Int()             GICR &= ~0x80
 #define  EnableRTC_Int()              GICR |=  0x80
@@ -239,6 +327,16 @@ extern   s_usb             USB;
 #define  LCD_E_HIGH()            (PORTD |=  0x80)
 
 
+// timer0 defines -> CTC-mode with 1.8432MHz/8 = 230400 counts per second
+#define  TIMER0_OCR_1MS_SHORT           229     // 230 counts per ms
+#define  TIMER0_OCR_1MS_LONG            230     // 231 counts per ms
+#define  TIMER0_LONG_TICKS_PER_SEC      400     // 600*230 + 400*231 = 230400 counts
+
+// system-clock in RAM -> resynced from the RTC after this time
+#define  CLOCK_SYNC_INTERVAL            600     // sec
+#define  SECONDS_PER_DAY                86400L
+
+
 // keyboard defines
 #define  KEY_UP                         0x3D
 #define  KEY_DOWN                       0x2F
@@ -252,19 +350,41 @@ extern   s_usb             USB;
 
 #define  PULSE_INPUT_DEBOUNCE_TIME_MS   50
 
+// count the impulse-input (PC6 = TOSC1) by timer2 in async-mode instead of
+// polling + debouncing it every 1ms -> CPU sleeps in power-save while counting
+// NOTE: needs a hardware-rework of this board, don't enable it without :
+//  - AS2 gives TOSC1 (PC6) AND TOSC2 (PC7) to the oscillator -> PC7 is the
+//    USB-stick power-switch, it has to be moved to a free pin and
+//    USB_StickPowerEnable()/USB_StickPowerDisable() changed accordingly
+//  - TOSC1 is the input of the 32kHz crystal-amplifier, the datasheet doesn't
+//    recommend an external clock there -> drive it with a clean square-wave
+//    (RC + schmitt-trigger), which also debounces the input
+//#define  IMPULSE_INPUT_HW_COUNTER
+
+#ifdef IMPULSE_INPUT_HW_COUNTER
+#warning "IMPULSE_INPUT_HW_COUNTER takes PC7 (USB-stick power) -> hardware-rework needed"
+#endif
+
 
 // uart defines
 #define  BAUDRATE_9600                  1
 #define  BAUDRATE_115200                2
+#define  BAUDRATE_230400                3       // double-speed (U2X), 0% error at 1.8432MHz
 
 #define  UART_TX_EN                     0x08
 #define  UART_RX_EN                     0x10
+#define  UART_UDRE_INT_EN               0x20
 #define  UART_RX_INT_EN                 0x80
 #define  UART_URSEL                     0x80
 #define  UART_8BIT                      0x06
+#define  UART_TXC                       0x40
+#define  UART_U2X                       0x02
 
 #define  EnableUartInterrupt()          (UCSRB |= UART_RX_INT_EN)
 #define  DisableUartInterrupt()         (UCSRB &= ~UART_RX_INT_EN)
+#define  EnableUartTxInterrupt()        (UCSRB |= UART_UDRE_INT_EN)
+#define  DisableUartTxInterrupt()       (UCSRB &= ~UART_UDRE_INT_EN)
+#define  IsUartTxPending()              (USB.TxRing.Head != USB.TxRing.Tail)
 
 
 
@@ -274,7 +394,19 @@ int main(void);
 
 void InstallInterrupts(void);
 
-BYTE WaitEventTimeout(BYTE event, WORD timeout);
+BYTE WaitEventTimeout(WORD event, WORD timeout);
+
+BYTE IsSystemTickRequired(void);
+
+void ResyncSystemTimer(LONG stop_time);
+
+void SystemSleep(void);
+
+void WaitForInterrupt(WORD event);
+
+BYTE PostWork(BYTE id);
+
+BYTE GetWork(s_work* work);
 
 
 #endif
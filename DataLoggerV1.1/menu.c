@@ -131,9 +131,15 @@ menu_t sub_system_settings =
        .name = STRING_MENU_ERASE_SENSORLOG,
        .value = 0,
       },
+      // align measure-intervals to the wall-clock
+      {.flags = 0,
+       .select = m_select_align_intervals,
+       .name = STRING_MENU_ALIGN_INTERVALS,
+       .value = 0,
+      },
 
    },
-   .num_entries = 7,
+   .num_entries = 8,
    .previous = NULL,
 };
 
@@ -283,8 +289,8 @@ void m_select_display_uALFAT_version(void *arg, char *name)
 {
   BYTE result;
   
-  result = InitUSB_Device();     // open connection to uALFAT and get version
-  StopUSB_Device();     // shut down connection and power-off
+  result = USB_SessionOpen();    // open connection to uALFAT and get version
+  USB_SessionClose();   // shut down connection and power-off
 
   ClearScreen();
   PrintLCD(1,1,STRING_MENU_UALFAT_VERSION);
@@ -369,14 +375,14 @@ void m_select_erase_errorlog(void *arg, char *name)
 /////////////////////////////////////////////////////////////////////////
 void m_select_erase_sensorlog(void *arg, char *name)
 {
-   BYTE x[2] = {0,0};
-
    ClearEvent(EVENT_KEY_CHANGED);
    ClearScreen();
    PrintLCD(1,1,STRING_ERROR_ERASE_1ST);              // show "erase measures"
    PrintLCD(1,2,STRING_ERASE_SENSORLOG);
 
-   EEPROM_Bulk_Write(EXT_EEPROM_NUM_LOGS_POS, 2, &x[0]); // erase logging-index
+   LogBlockDiscard();
+   Sensor.LogStart = Sensor.LogEnd;                   // erase logging-index -> ring is empty
+   LogIndexCommit();
 
    Sleep(500);                                        // wait 500ms
    PrintLCD(13,2,STRING_DONE);
@@ -385,6 +391,27 @@ void m_select_erase_sensorlog(void *arg, char *name)
 }
 
 
+/////////////////////////////////////////////////////////////////////////
+// function : toggle alignment of the measure-intervals to wall-clock  //
+/////////////////////////////////////////////////////////////////////////
+void m_select_align_intervals(void *arg, char *name)
+{
+   ClearEvent(EVENT_KEY_CHANGED);
+   SetIntervalAlignment(!Sensor.AlignIntervals);      // re-schedules all sensors
+
+   ClearScreen();
+   PrintLCD(1,1,STRING_MENU_ALIGN_INTERVALS);
+   PrintLCD(1,2,"-->");
+   if(Sensor.AlignIntervals)
+      PrintLCD(5,2,STRING_SET_SENSOR_ENABLE);
+   else
+      PrintLCD(5,2,STRING_SET_SENSOR_DISABLE);
+
+   while(!(System.EventID & (EVENT_KEY_CHANGED | EVENT_BOX_CLOSED)));
+   ClearEvent(EVENT_KEY_CHANGED);                     // clear key event
+}
+
+
 /////////////////////////////////////////////////////////////////////////
 // function : set sensordefaults for Anarehla                          //
 /////////////////////////////////////////////////////////////////////////
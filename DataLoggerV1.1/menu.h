@@ -136,6 +136,7 @@ void m_select_uALFAT_update_firmware(void *arg, char *name);
 void m_select_show_errorlog(void *arg, char *name);
 void m_select_erase_errorlog(void *arg, char *name);
 void m_select_erase_sensorlog(void *arg, char *name);
+void m_select_align_intervals(void *arg, char *name);
 void m_select_sensor_profile(void *arg, char *name);
 
 
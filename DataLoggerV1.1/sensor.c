@@ -10,6 +10,8 @@
 
 
 s_sensor    Sensor;
+s_adc       Adc;
+s_log_block LogBlock;
 
 
 /////////////////////////////////////////////////////////////////////////
@@ -186,6 +188,8 @@ void SetMeasurementInterval(BYTE sensor_nr)
   if((Sensor.Nr[sensor_nr-1].Type == Sensor_4_20mA) &&            // if sensor-interval slower than 1min
      (Sensor.Nr[sensor_nr-1].MeasureInterval < 60))               //  -> switch to fastservice
      Sensor.Nr[sensor_nr-1].Type = Sensor_4_20mA_FastSample;
+
+  Sensor.Nr[sensor_nr-1].NextMeasurement = 0;                     // scheduled by the next SensorService()
 }
 
 
@@ -200,6 +204,10 @@ void ImpulseInputService(void)
   BYTE in;
 
 
+#ifdef IMPULSE_INPUT_HW_COUNTER
+  return;                                 // impulses are counted by timer2
+#endif
+
   // only check input if sensortype == IMPULSE_INPUT + ENABLED
   if((Sensor.Nr[0].Type != Sensor_Impulse) || (Sensor.Nr[0].Enabled != Sensor_Enable))
     return;
@@ -216,10 +224,10 @@ void ImpulseInputService(void)
       {
         Sensor.Impulse.OldValue = in;     // store new 'old-value'
 
-        if(Sensor.Impulse.Pulses < 0xFFFF)// prevent overflow
+        if(Sensor.Impulse.Pulses < 0xFFFFFFFF)  // prevent overflow
         {
           Sensor.Impulse.Pulses++;        // increment detected pulses
-          Sensor.Nr[0].LastMeasurement = Sensor.Impulse.Pulses;
+          Sensor.Nr[0].LastMeasurement = (Sensor.Impulse.Pulses < 0xFFFF) ? Sensor.Impulse.Pulses : 0xFFFF;
           SetEvent(EVENT_IMPULSE_INPUT_TRIGGERED);
           SetTimerEvent(EVENT_UPDATE_DISPLAY_VALUE);
         }
@@ -242,40 +250,232 @@ void ImpulseInputService(void)
 
 
 /////////////////////////////////////////////////////////////////////////
-// function : read analog value of given ADC-channel (0...3)           //
-// given    : number of sensor                                         //
+// function : request a conversion of the given ADC-channels. the ADC  //
+//            is powered up if idle, the channels are converted round- //
+//            robin by the ADC-interrupt -> EVENT_ADC_READY when done  //
+// given    : bitmask of channels (1 << ADCHL_xxx)                     //
 // return   : nothing                                                  //
 /////////////////////////////////////////////////////////////////////////
-WORD GetSensorAD_Value(BYTE channel)
+void ADC_RequestConversion(BYTE chl_mask)
 {
-  BYTE i;
-  WORD mean_value = 0;
+  BYTE chl = 0;
 
-  ADMUX   = channel;                      // select channel of AD-MUX
-  ADCSRA  = 0x84;                         // init AD-converter
+  chl_mask &= ((1 << NUM_ADC_CHANNELS) - 1);
+  if(chl_mask == 0)
+    return;
 
-  // get eight measurements ...
-  for(i=0; i<8; i++)
+  GetMutex();
+  Adc.Ready &= ~chl_mask;                 // results of these channels are outdated
+
+  if(Adc.Pending == 0)                    // converter idle -> start with 1st channel
   {
-    ADCSRA |= 0x40;                       // start conversion
-    while(!(ADCSRA & 0x10));              // wait until conversion is completed
-    ADCSRA |= 0x10;                       // clear flag
+    while(!(chl_mask & (1 << chl)))
+      chl++;
 
-    mean_value += (ADCL | (ADCH << 8));   // get value
+    Adc.Pending = chl_mask;
+    Adc.Channel = chl;
+    ADMUX       = chl;                    // select channel of AD-MUX
+    ADCSRA      = 0xCC;                   // enable ADC + int, prescaler 16, start conversion
   }
+  else
+    Adc.Pending |= chl_mask;              // converter running -> add to round-robin
+  ReleaseMutex();
+}
+
+
+
+/////////////////////////////////////////////////////////////////////////
+// function : ADC conversion finished -> this function is called by    //
+//             the ADC-CONVERSION-COMPLETE-INTERRUPT                   //
+// given    : nothing                                                  //
+// return   : nothing                                                  //
+/////////////////////////////////////////////////////////////////////////
+void ADC_ConversionComplete(void)
+{
+  BYTE chl = Adc.Channel;
+  WORD val;
+
+  val  = ADCL;                            // ADCL has to be read first
+  val |= (ADCH << 8);
+
+  Adc.Slot[chl].Sum += val;
+  if(++Adc.Slot[chl].Count >= ADC_OVERSAMPLING)
+  {
+    Adc.Slot[chl].Result = Adc.Slot[chl].Sum / ADC_OVERSAMPLING;  // calculate mean-value
+    Adc.Slot[chl].Sum    = 0;
+    Adc.Slot[chl].Count  = 0;
+
+    Adc.Pending &= ~(1 << chl);           // channel finished
+    Adc.Ready   |=  (1 << chl);
+
+    if(Adc.Fast & (1 << chl))             // sample of the fast-service -> store at once
+    {
+      Adc.Fast &= ~(1 << chl);
+      SensorStoreFastSample(chl, Adc.Slot[chl].Result);
+    }
+  }
+
+  if(Adc.Pending == 0)                    // all requested channels converted
+  {
+    ADCSRA = 0x00;                        // disable ADC
+    ADMUX  = 0x00;
+    SetEvent(EVENT_ADC_READY);
+    return;
+  }
+
+  do                                      // select next requested channel
+  {
+    if(++chl >= NUM_ADC_CHANNELS)
+      chl = 0;
+  }while(!(Adc.Pending & (1 << chl)));
+
+  Adc.Channel = chl;
+  ADMUX       = chl;
+  ADCSRA     |= 0x40;                     // start next conversion
+}
+
+
+
+/////////////////////////////////////////////////////////////////////////
+// function : get result of the given channel and mark it as read      //
+// given    : ADC-channel                                              //
+// return   : mean-value of the last conversion-cycle                  //
+/////////////////////////////////////////////////////////////////////////
+WORD ADC_GetResult(BYTE channel)
+{
+  WORD val;
+
+  GetMutex();
+  Adc.Ready &= ~(1 << channel);
+  val = Adc.Slot[channel].Result;
+  ReleaseMutex();
+
+  return val;
+}
+
+
 
-  ADCSRA = 0x00;                          // disable ADC
-  ADMUX  = 0x00;
+/////////////////////////////////////////////////////////////////////////
+// function : wait for the result of a requested channel               //
+//            -> never call this function from an interrupt            //
+// given    : ADC-channel                                              //
+// return   : mean-value of the conversion                             //
+/////////////////////////////////////////////////////////////////////////
+WORD ADC_WaitResult(BYTE channel)
+{
+  while(!(Adc.Ready & (1 << channel)))    // other interrupts are still served
+    WaitForInterrupt(EVENT_NO_EVENT);
 
-  return (mean_value / 8);                // calculate mean-value and return
+  return ADC_GetResult(channel);
 }
 
 
 
 /////////////////////////////////////////////////////////////////////////
-// function : search minimumvalue of "MeasureInterval" and return sec  //
+// function : read analog value of given ADC-channel (0...4)           //
+//            -> never call this function from an interrupt            //
+// given    : number of sensor                                         //
+// return   : mean-value of the conversion                             //
+/////////////////////////////////////////////////////////////////////////
+WORD GetSensorAD_Value(BYTE channel)
+{
+  ADC_RequestConversion(1 << channel);
+  return ADC_WaitResult(channel);
+}
+
+
+
+/////////////////////////////////////////////////////////////////////////
+// function : timer2 overflowed -> 256 impulses counted by hardware    //
+//            called by timer2-overflow-interrupt                      //
 // given    : nothing                                                  //
-// return   : LONG number of seconds for next wakeup/measurement       //
+// return   : nothing                                                  //
+/////////////////////////////////////////////////////////////////////////
+void ImpulseCounterOverflow(void)
+{
+  if(Sensor.Impulse.Pulses < (0xFFFFFFFF - 0xFF))   // prevent overflow
+    Sensor.Impulse.Pulses += 0x100;
+  else
+    Sensor.Impulse.Pulses = 0xFFFFFFFF;
+}
+
+
+
+/////////////////////////////////////////////////////////////////////////
+// function : get impulses counted since the last call and restart     //
+// given    : nothing                                                  //
+// return   : number of impulses                                       //
+/////////////////////////////////////////////////////////////////////////
+LONG ImpulseInputHarvest(void)
+{
+  LONG pulses;
+#ifdef IMPULSE_INPUT_HW_COUNTER
+  BYTE cnt;
+
+  GetMutex();
+    cnt = TCNT2;
+    if(TIFR & 0x40)                     // overflow not serviced yet
+    {
+      TIFR = 0x40;
+      cnt  = TCNT2;                     // re-read -> wrapped counter
+      ImpulseCounterOverflow();
+    }
+    pulses = Sensor.Impulse.Pulses + cnt - Sensor.Impulse.LastCount;
+    if(pulses < Sensor.Impulse.Pulses)  // saturated accumulator
+      pulses = 0xFFFFFFFF;
+    Sensor.Impulse.Pulses    = 0x00;
+    Sensor.Impulse.LastCount = cnt;     // TCNT2 isn't written -> no async-sync
+  ReleaseMutex();
+#else
+  GetMutex();
+    pulses = Sensor.Impulse.Pulses;
+    Sensor.Impulse.Pulses = 0x00;
+  ReleaseMutex();
+#endif
+
+  return pulses;
+}
+
+
+
+/////////////////////////////////////////////////////////////////////////
+// function : check if a sensor is sampled by the fast-service         //
+// given    : nothing                                                  //
+// return   : TRUE if at least one fast-sampling sensor is active      //
+/////////////////////////////////////////////////////////////////////////
+BYTE IsFastSamplingActive(void)
+{
+  BYTE i;
+
+  for(i=0; i<NUM_SENSOR; i++)
+  {
+    if((Sensor.Nr[i].Enabled == Sensor_Enable) &&
+       (Sensor.Nr[i].Type == Sensor_4_20mA_FastSample) &&
+       (Sensor.Nr[i].MeasureInterval != 0))
+      return TRUE;
+  }
+
+  return FALSE;
+}
+
+
+
+/////////////////////////////////////////////////////////////////////////
+// function : check if the impulse-input has to be polled              //
+// given    : nothing                                                  //
+// return   : TRUE if sensor 1 is an enabled impulse-input             //
+/////////////////////////////////////////////////////////////////////////
+BYTE IsImpulseInputActive(void)
+{
+  return ((Sensor.Nr[0].Type == Sensor_Impulse) && (Sensor.Nr[0].Enabled == Sensor_Enable));
+}
+
+
+
+/////////////////////////////////////////////////////////////////////////
+// function : search the earliest deadline of the RTC-scheduled sensors//
+// given    : nothing                                                  //
+// return   : LONG epoch-seconds of the next wakeup/measurement        //
 /////////////////////////////////////////////////////////////////////////
 LONG GetNextMeasurementTime(void)
 {
@@ -284,10 +484,10 @@ LONG GetNextMeasurementTime(void)
 
   for(i=0; i<NUM_SENSOR; i++)
   {
-    if(Sensor.Nr[i].Enabled == Sensor_Enable)   // only get timer-reload if sensor is enabled
+    if(IsSensorScheduled(i))                    // only get timer-reload if sensor is enabled
     {
-      if(ret > Sensor.Nr[i].MeasureIntervalWorkTimer)    // get number of pending seconds for next measurement
-         ret = Sensor.Nr[i].MeasureIntervalWorkTimer;    // safe minimum
+      if(ret > Sensor.Nr[i].NextMeasurement)    // get deadline of next measurement
+         ret = Sensor.Nr[i].NextMeasurement;    // safe minimum
     }
   }
 
@@ -297,13 +497,70 @@ LONG GetNextMeasurementTime(void)
 
 
 /////////////////////////////////////////////////////////////////////////
-// function : check sensors every second                               //
+// function : move the deadline of a sensor behind the given time      //
+//            -> deadlines are multiples of the interval, missed ones  //
+//               (long operations, power-down) are skipped             //
+//            -> Sensor.AlignIntervals : first deadline at a multiple  //
+//               of the interval since 2000 (wall-clock)               //
+// given    : number of sensor, actual epoch-seconds                   //
+// return   : nothing                                                  //
+/////////////////////////////////////////////////////////////////////////
+void SensorScheduleNext(BYTE sensor_nr, LONG now)
+{
+  LONG interval = Sensor.Nr[sensor_nr].MeasureInterval;
+
+  if(Sensor.Nr[sensor_nr].NextMeasurement == 0)   // not scheduled yet
+  {
+    if(Sensor.AlignIntervals)
+      Sensor.Nr[sensor_nr].NextMeasurement = now - (now % interval) + interval;  // next wall-clock multiple
+    else
+      Sensor.Nr[sensor_nr].NextMeasurement = now + interval;                     // interval starts now
+    return;
+  }
+
+  Sensor.Nr[sensor_nr].NextMeasurement += interval;
+  if(Sensor.Nr[sensor_nr].NextMeasurement <= now)
+    Sensor.Nr[sensor_nr].NextMeasurement += ((now - Sensor.Nr[sensor_nr].NextMeasurement) / interval + 1) * interval;
+}
+
+
+
+/////////////////////////////////////////////////////////////////////////
+// function : switch alignment of the intervals to the wall-clock      //
+//            -> all deadlines are re-calculated, no measurement now   //
+// given    : TRUE = aligned, FALSE = interval starts at configuration //
+// return   : nothing                                                  //
+/////////////////////////////////////////////////////////////////////////
+void SetIntervalAlignment(BYTE align)
+{
+  BYTE i;
+  LONG now = GetSystemEpoch();
+
+  Sensor.AlignIntervals = align;
+
+  for(i=0; i<NUM_SENSOR; i++)
+  {
+    Sensor.Nr[i].NextMeasurement = 0;
+    if(IsSensorScheduled(i))
+      SensorScheduleNext(i, now);
+  }
+
+  SensorService();                      // re-load RTC-timer with the new deadlines
+}
+
+
+
+/////////////////////////////////////////////////////////////////////////
+// function : check sensors every second -> called by the systemtimer  //
+//            -> only requests the conversions, samples are stored by  //
+//               the ADC-interrupt, so blocking code doesn't lose any  //
 // given    : nothing                                                  //
 // return   : nothing                                                  //
 /////////////////////////////////////////////////////////////////////////
 void SensorServiceFast(void)
 {
-   BYTE i, idx, pos;
+   BYTE i;
+   BYTE chl_mask = 0;
 
    for(i=0; i<NUM_SENSOR; i++)
    {
@@ -319,29 +576,53 @@ void SensorServiceFast(void)
       if(Sensor.Nr[i].MeasureInterval == 0)
          continue;
       
-      // check if time expired -> do measurement
+      // check if time expired -> request a measurement
       if(Sensor.Nr[i].MeasureIntervalWorkTimer > 1)
          Sensor.Nr[i].MeasureIntervalWorkTimer--;
       else
       {
-         Sensor.Nr[i].FastLog.pos_write++;
-         if((Sensor.Nr[i].FastLog.pos_write % FAST_LOG_BUF_SIZE) == 0)
-         {
-            Sensor.Nr[i].FastLog.buf_idx_ready_for_usb = (Sensor.Nr[i].FastLog.buf_select & 0x01);
-            SetTimerEvent(EVENT_FASTLOGGING_SAFE2_USB);
-            Sensor.Nr[i].FastLog.buf_select++;
-         }            
-
-         idx = (Sensor.Nr[i].FastLog.buf_select & 0x01);                // select 1st or 2nd buffer
-         pos = (Sensor.Nr[i].FastLog.pos_write & (FAST_LOG_BUF_SIZE-1));
-         
-         Sensor.Nr[i].FastLog.buf[idx][pos] = GetSensorAD_Value(i);           // do a measurement
-         Sensor.Nr[i].LastMeasurement = Sensor.Nr[i].FastLog.buf[idx][pos];   // temp-safe for displayupdate
+         chl_mask |= (1 << i);
          Sensor.Nr[i].MeasureIntervalWorkTimer = Sensor.Nr[i].MeasureInterval;
-         
-         SetTimerEvent(EVENT_UPDATE_DISPLAY_VALUE);
       }
    }
+
+   // conversion is done by the ADC-interrupt -> SensorStoreFastSample()
+   Adc.Fast |= chl_mask;
+   ADC_RequestConversion(chl_mask);
+}
+
+
+
+/////////////////////////////////////////////////////////////////////////
+// function : store a finished conversion of a fast-sampling sensor    //
+//            -> called by the ADC-interrupt                           //
+// given    : number of sensor, mean-value of the conversion           //
+// return   : nothing                                                  //
+/////////////////////////////////////////////////////////////////////////
+void SensorStoreFastSample(BYTE i, WORD val)
+{
+   BYTE idx, pos;
+
+   // ignore if sensor was switched to an other mode meanwhile
+   if(Sensor.Nr[i].Type != Sensor_4_20mA_FastSample)
+      return;
+
+   Sensor.Nr[i].FastLog.pos_write++;
+   if((Sensor.Nr[i].FastLog.pos_write % FAST_LOG_BUF_SIZE) == 0)
+   {
+      Sensor.Nr[i].FastLog.buf_idx_ready_for_usb = (Sensor.Nr[i].FastLog.buf_select & 0x01);
+      Sensor.Nr[i].FastLog.ready_for_usb = TRUE;
+      SetTimerEvent(EVENT_FASTLOGGING_SAFE2_USB);
+      Sensor.Nr[i].FastLog.buf_select++;
+   }
+
+   idx = (Sensor.Nr[i].FastLog.buf_select & 0x01);                // select 1st or 2nd buffer
+   pos = (Sensor.Nr[i].FastLog.pos_write & (FAST_LOG_BUF_SIZE-1));
+
+   Sensor.Nr[i].FastLog.buf[idx][pos] = val;                            // get measurement
+   Sensor.Nr[i].LastMeasurement = Sensor.Nr[i].FastLog.buf[idx][pos];   // temp-safe for displayupdate
+
+   SetTimerEvent(EVENT_UPDATE_DISPLAY_VALUE);
 }
 
 
@@ -354,44 +635,60 @@ void SensorServiceFast(void)
 void SensorService(void)
 {
    BYTE i;
-   LONG time = FALSE;
+   BYTE active = FALSE;
+   BYTE due = 0;
+   LONG now, time;
 
-   //------------- re-calc the sensor-interval-times ---------------//
+   //------------- measure sensors with expired deadline -----------//
+   now = GetSystemEpoch();
    for(i=0; i<NUM_SENSOR; i++)
    {
-      // ignore if sensor is disabled
-      if(Sensor.Nr[i].Enabled != Sensor_Enable)
-         continue;
-         
-      if(Sensor.Nr[i].Type == Sensor_4_20mA_FastSample)  // skip (done in SensorServiceFast)
+      // ignore if sensor is disabled or done in SensorServiceFast
+      if(!IsSensorScheduled(i))
          continue;
 
-      time = TRUE;                                      // interval still running
+      active = TRUE;                                    // interval still running
 
-      // check if time expired -> do measurement
-      if(Sensor.Nr[i].MeasureIntervalWorkTimer == 0)
-      {
-         DoSensorMeasurement(i);
-         Sensor.Nr[i].MeasureIntervalWorkTimer = Sensor.Nr[i].MeasureInterval;
-      }
+      if(Sensor.Nr[i].NextMeasurement > (now + Sensor.Nr[i].MeasureInterval))
+         Sensor.Nr[i].NextMeasurement = 0;              // time was set back -> restart interval
+
+      if((Sensor.Nr[i].NextMeasurement == 0) && Sensor.AlignIntervals)
+         SensorScheduleNext(i, now);                    // aligned -> 1st measurement on the wall-clock grid
+
+      // check if deadline reached -> measure together with all other due sensors
+      if(Sensor.Nr[i].NextMeasurement <= now)
+         due |= (1 << i);
    }
 
-   if(!time)          // return if no sensor is active
+   if(!active)        // return if no sensor is active
       return;
 
+   if(due)
+   {
+      DoSensorMeasurement(due);
+      for(i=0; i<NUM_SENSOR; i++)
+         if(due & (1 << i))
+            SensorScheduleNext(i, now);
+   }
 
-   //------------- re-load the external RTC-counter ----------------//
-   time = GetNextMeasurementTime();          // get next timer-value
-   time = time / 60;    // get minutes
-   if(time > 0xFF)      // prevent overflow
-      time = 0xFF;
-
-   LoadAlarmTimer((BYTE)(time), RTC_TIMER_MIN); // load external RTC-timer
-   time = time * 60;                            // convert to seconds
 
-   // recalc value for next reload
-   for(i=0; i<NUM_SENSOR; i++)
-      Sensor.Nr[i].MeasureIntervalWorkTimer -= time;
+   //------------- re-load the external RTC-counter ----------------//
+   now  = GetSystemEpoch();                  // measurements took some time
+   time = GetNextMeasurementTime();
+   if(time > now)
+      time -= now;                           // seconds till the next deadline
+   else
+      time = 1;                              // already reached -> at the next second
+
+   if(time <= 0xFF)
+      LoadAlarmTimer((BYTE)(time), RTC_TIMER_SEC);   // exact to the second
+   else
+   {
+      time = time / 60;                      // wake early, the rest is done with seconds
+      if(time > 0xFF)                        // prevent overflow
+         time = 0xFF;
+      LoadAlarmTimer((BYTE)(time), RTC_TIMER_MIN);
+   }
 
    StartAlarmTimer();                  // start timer of external RTC
 }
@@ -399,80 +696,435 @@ void SensorService(void)
 
 
 /////////////////////////////////////////////////////////////////////////
-// function : measure value of given sensor  (0...3)                   //
-// given    : number of sensor                                         //
+// function : measure values of given sensors  (bit 0...3)             //
+//            -> one supply/temp-read and one timestamp for all        //
+// given    : bitmask of sensors                                       //
 // return   : nothing                                                  //
 /////////////////////////////////////////////////////////////////////////
-void DoSensorMeasurement(BYTE sensor_nr)
+void DoSensorMeasurement(BYTE sensor_mask)
 {
-  LONG          tmp;
+  LONG          tmp, time;
+  BYTE          i;
+  BYTE          chl_mask = (1 << ADCHL_SUPPLY_VOLTAGE);
+
+  // convert supply-voltage (+ sensor-inputs) while the board-temp is measured
+  for(i=0; i<NUM_SENSOR; i++)
+  {
+    if((sensor_mask & (1 << i)) && (Sensor.Nr[i].Type != Sensor_Impulse))
+      chl_mask |= (1 << i);
+  }
+  ADC_RequestConversion(chl_mask);
 
   // get actual system-parameters
   ReadOnboardTemp();                                      // read board-temperature
-  tmp = GetSensorAD_Value(ADCHL_SUPPLY_VOLTAGE);
+  tmp = ADC_WaitResult(ADCHL_SUPPLY_VOLTAGE);
   System.SupplyVoltage = (WORD)((tmp * 13880) / 1024);    // calculate mV-value
 
 
   // get sensorvalues and store to external EEPROM
-  if(Sensor.Nr[sensor_nr].Type == Sensor_Impulse)
-  {
-    LogValues2EEprom(Sensor.Impulse.Pulses, sensor_nr);         // safe data to external EEPROM
-    Sensor.Impulse.Pulses = 0x00;
-    Sensor.Nr[sensor_nr].LastMeasurement = 0x00;
-  }
-  else
+  time = GetSystemEpoch();
+  for(i=0; i<NUM_SENSOR; i++)
   {
-    tmp = GetSensorAD_Value(sensor_nr);
-    Sensor.Nr[sensor_nr].LastMeasurement = tmp;
-    LogValues2EEprom(tmp, sensor_nr);  // safe data to external EEPROM
+    if(!(sensor_mask & (1 << i)))
+      continue;
+
+    if(Sensor.Nr[i].Type == Sensor_Impulse)
+    {
+      LogValues2EEprom(ImpulseInputHarvest(), i, time);   // safe data to external EEPROM
+      Sensor.Nr[i].LastMeasurement = 0x00;
+    }
+    else
+    {
+      tmp = ADC_WaitResult(i);
+      Sensor.Nr[i].LastMeasurement = tmp;
+      LogValues2EEprom(tmp, i, time);   // safe data to external EEPROM
+    }
   }
-  
+
+  if(System.SupplyVoltage < SUPPLY_VOLTAGE_LOW_MV)
+    LogBlockClose();                    // power may fail -> write through (one page for all)
+
   SetTimerEvent(EVENT_UPDATE_DISPLAY_VALUE);
 }
 
 
 
 /////////////////////////////////////////////////////////////////////////
-// function : safe measured values to external EEPROM  size=9Bytes     //
-// given    : WORD - sensorvalue, BYTE number of sensor                //
-// return   : nothing                                                  //
+// function : safe measured value as entry of the open log-block       //
+// given    : LONG - sensorvalue, BYTE number of sensor, epoch-seconds //
+// return   : TRUE = logged, FALSE = log-area full                     //
 /////////////////////////////////////////////////////////////////////////
-BYTE LogValues2EEprom(WORD val, BYTE num)
+BYTE LogValues2EEprom(LONG val, BYTE num, LONG time)
 {
-  union union_w_b   num_logs;
-  s_eeprom_logging  eeprom_log;
+  s_log_entry  entry;
+  LONG         tod;
+
 
+  //------------- a block holds entries of one day only ----------------//
+  tod  = time % SECONDS_PER_DAY;
 
-  //---------------- get index where log should be safed ---------------//
-  EEPROM_Bulk_Read(EXT_EEPROM_NUM_LOGS_POS, sizeof(WORD), &num_logs.b[0]);
-  if(num_logs.w >= EXT_EERPOM_MAX_LOGS)             // max storagesize reached
+  if((LogBlock.Len > 0) &&
+     (((time / SECONDS_PER_DAY) != (((s_log_block_header*)LogBlock.Data)->Time / SECONDS_PER_DAY)) ||   // other date
+      (tod < LogBlock.LastTod)))                                                // time was set back
+    LogBlockClose();
+
+  if(LogBlock.Len == 0)
   {
-    if(USB_LogSensorValues())                       // -> safe logs to USB-Stick
-      num_logs.w = 0x0000;                          //  if safed to stick, start from zero in EEPROM
+    if(!LogBlockOpen(time))
+      return FALSE;                                 // log-area full
   }
 
   //---------------- get data which should be logged ------------------//
-  eeprom_log.timestamp     = EncodeSystemTime((s_time*)(&System.Time));
-  eeprom_log.boardtemp     = System.BoardTemp;
-  eeprom_log.supplyvoltage = System.SupplyVoltage;
+  entry.Sensor = (num & 0x03);
+  entry.Value  = val;
+  entry.Delta  = tod - LogBlock.LastTod;
+  entry.Type   = ((Sensor.Nr[num].Type-1) & 0x03);
 
-  eeprom_log.sensorvalue   = ((num & 0x03) << 14);                      // bits 15 .. 14  -> number of sensor
-  eeprom_log.sensorvalue  |= (((Sensor.Nr[num].Type-1) & 0x03) << 12);  // bits 13 .. 12  -> type of sensor
-  eeprom_log.sensorvalue  |= (val & 0x0FFF);                            // bits 11 .. 0   -> sensorvalue
+  if((Sensor.Nr[num].Type == Sensor_Impulse) && (val > 0x0FFF))
+  {
+    if(val > LOG_IMPULSE_LONG_MAX)                  // prevent overflow
+      entry.Value = LOG_IMPULSE_LONG_MAX;
+    entry.Type = LOG_TYPE_IMPULSE_LONG;
+  }
 
-  EEPROM_Bulk_Write(EXT_EEPROM_START_OF_LOGS + (num_logs.w * sizeof(s_eeprom_logging)),
-                    sizeof(s_eeprom_logging),
-                    (BYTE*)(&eeprom_log));
+  LogBlock.Len    += LogEntryEncode(&entry, &LogBlock.Data[LogBlock.Len]);
+  LogBlock.LastTod = tod;
 
-  //---------------- write startindex of next sensor-log ---------------//
-  num_logs.w++;                                   // point to start of next log
-  EEPROM_Bulk_Write(EXT_EEPROM_NUM_LOGS_POS, sizeof(WORD), &num_logs.b[0]);
+  //-------- write block if full -> low power is done by the caller -----//
+  if((LogBlock.Cap - LogBlock.Len) < LOG_ENTRY_MAX_SIZE)
+    LogBlockClose();
 
 
   return TRUE;
 }
 
 
+
+/////////////////////////////////////////////////////////////////////////
+// function : code one log-entry                                       //
+//            WORD info  : sensor(15..14) type(13..12) value(11..0)    //
+//            1..3 bytes : time-delta, 7bit per byte, bit7 = more      //
+//            WORD       : value bits 27..12 if LOG_TYPE_IMPULSE_LONG  //
+// given    : entry, pointer where coded entry is stored               //
+// return   : number of bytes                                          //
+/////////////////////////////////////////////////////////////////////////
+BYTE LogEntryEncode(s_log_entry* entry, BYTE* data)
+{
+  BYTE  len = 2;
+  WORD  info;
+  LONG  delta = entry->Delta;
+
+  info  = ((entry->Sensor & 0x03) << 14);
+  info |= ((entry->Type & 0x03) << 12);
+  info |= (entry->Value & 0x0FFF);
+  data[0] = (BYTE)(info);
+  data[1] = (BYTE)(info >> 8);
+
+  do
+  {
+    data[len] = (delta & 0x7F);
+    delta >>= 7;
+    if(delta)
+      data[len] |= 0x80;
+    len++;
+  } while(delta && (len < 5));
+
+  if(entry->Type == LOG_TYPE_IMPULSE_LONG)
+  {
+    data[len++] = (BYTE)(entry->Value >> 12);
+    data[len++] = (BYTE)(entry->Value >> 20);
+  }
+
+  return len;
+}
+
+
+
+/////////////////////////////////////////////////////////////////////////
+// function : decode one log-entry  -> see LogEntryEncode()            //
+// given    : coded entry, number of valid bytes, decoded entry        //
+// return   : number of bytes of the entry, 0 = entry invalid          //
+/////////////////////////////////////////////////////////////////////////
+BYTE LogEntryDecode(BYTE* data, BYTE len, s_log_entry* entry)
+{
+  BYTE  i = 2;
+  BYTE  shift = 0;
+  WORD  info;
+
+  if(len < 3)
+    return 0;
+
+  info          = data[0] | (data[1] << 8);
+  entry->Sensor = (info >> 14);
+  entry->Type   = (info >> 12) & 0x03;
+  entry->Value  = (info & 0x0FFF);
+  entry->Delta  = 0;
+
+  do
+  {
+    if(i >= len)
+      return 0;
+    entry->Delta |= ((LONG)(data[i] & 0x7F) << shift);
+    shift += 7;
+  } while(data[i++] & 0x80);
+
+  if(entry->Type == LOG_TYPE_IMPULSE_LONG)
+  {
+    if((i+2) > len)
+      return 0;
+    entry->Value |= ((LONG)data[i] << 12) | ((LONG)data[i+1] << 20);
+    i += 2;
+  }
+
+  return i;
+}
+
+
+
+/////////////////////////////////////////////////////////////////////////
+// function : get startaddress of a block written behind given address //
+//            -> a block doesn't start in the last bytes of a page     //
+//            -> log-area is a ring : wraps to the start of the area   //
+// given    : address behind the previous block                        //
+// return   : address of the block                                     //
+/////////////////////////////////////////////////////////////////////////
+LONG LogBlockStart(LONG addr)
+{
+  if((ExtEeprom.PageSize - (addr & (ExtEeprom.PageSize-1))) < LOG_BLOCK_MIN_SIZE)
+    addr = (addr | (ExtEeprom.PageSize-1)) + 1;     // start of next page
+
+  if((addr + LOG_BLOCK_MIN_SIZE) > ExtEeprom.Size)  // end of log-area -> wrap
+    addr = EXT_EEPROM_START_OF_LOGS;
+
+  return addr;
+}
+
+
+
+/////////////////////////////////////////////////////////////////////////
+// function : get address of the block following the given one         //
+//            -> invalid block : skip to the next page, blocks never   //
+//               cross a page so the 1st block of a page starts there  //
+// given    : address of a written block                               //
+// return   : address of next block, max. Sensor.LogEnd                //
+/////////////////////////////////////////////////////////////////////////
+LONG LogBlockNext(LONG addr)
+{
+  s_log_block_header  hdr;
+  LONG                next;
+
+  EEPROM_Bulk_Read(addr, sizeof(s_log_block_header), (BYTE*)(&hdr));
+  if((hdr.Marker != LOG_BLOCK_MARKER) || (hdr.Len <= sizeof(s_log_block_header)))
+  {
+    next = LogBlockStart((addr | (ExtEeprom.PageSize-1)) + 1);   // corrupted -> drop this page only
+    if(LogRingDistance(addr, Sensor.LogEnd) <= LogRingDistance(addr, next))
+      return Sensor.LogEnd;                         // end of ring is in this page
+    return next;
+  }
+
+  return LogBlockStart(addr + hdr.Len);
+}
+
+
+
+/////////////////////////////////////////////////////////////////////////
+// function : get number of bytes between two addresses in the ring    //
+// given    : start-address, end-address                               //
+// return   : number of bytes from start to end                        //
+/////////////////////////////////////////////////////////////////////////
+LONG LogRingDistance(LONG from, LONG to)
+{
+  if(to >= from)
+    return (to - from);
+
+  return (ExtEeprom.Size - from) + (to - EXT_EEPROM_START_OF_LOGS);
+}
+
+
+
+/////////////////////////////////////////////////////////////////////////
+// function : drop the oldest blocks which are overwritten by a block  //
+//            at the given address -> the block may grow till the end  //
+//            of its page, ring must not become 'empty' (start == end) //
+//            -> a running export skips the dropped blocks too         //
+// given    : address of the new block                                 //
+// return   : nothing                                                  //
+/////////////////////////////////////////////////////////////////////////
+void LogRingFree(LONG addr)
+{
+  LONG end = addr + (ExtEeprom.PageSize - (addr & (ExtEeprom.PageSize-1)));
+  LONG next = LogBlockStart(end);
+  LONG tail;
+
+  while((Sensor.LogStart != Sensor.LogEnd) &&
+        (((Sensor.LogStart >= addr) && (Sensor.LogStart < end)) || (Sensor.LogStart == next)))
+  {
+    tail = LogBlockNext(Sensor.LogStart);
+
+    if(IsUSB_ExportActive())                // export never reads behind the ring-tail
+    {
+      if(USB.Export.Addr == Sensor.LogStart)
+        USB.Export.Addr = tail;             // block is overwritten before it is safed
+      if(USB.Export.Start == Sensor.LogStart)
+        USB.Export.Start = tail;
+    }
+
+    Sensor.LogStart = tail;
+  }
+}
+
+
+
+/////////////////////////////////////////////////////////////////////////
+// function : open a new log-block behind the last one                 //
+//            -> the oldest blocks are overwritten if the ring is full //
+// given    : epoch-seconds of the first entry                         //
+// return   : TRUE if opened, FALSE if no external EEPROM              //
+/////////////////////////////////////////////////////////////////////////
+BYTE LogBlockOpen(LONG time)
+{
+  LONG                 addr;
+  s_log_block_header*  hdr = (s_log_block_header*)LogBlock.Data;
+
+  if(ExtEeprom.Size == 0)                           // no external EEPROM found
+    return FALSE;
+
+  addr = Sensor.LogEnd;
+  LogRingFree(addr);
+
+  LogBlock.Addr = addr;
+  LogBlock.Cap  = ExtEeprom.PageSize - (BYTE)(addr & (ExtEeprom.PageSize-1));
+
+  hdr->Marker        = LOG_BLOCK_MARKER;
+  hdr->Len           = 0;
+  hdr->Time          = time;
+  hdr->BoardTemp     = System.BoardTemp;
+  hdr->SupplyVoltage = System.SupplyVoltage;
+
+  LogBlock.Len     = sizeof(s_log_block_header);
+  LogBlock.LastTod = time % SECONDS_PER_DAY;
+
+  return TRUE;
+}
+
+
+
+/////////////////////////////////////////////////////////////////////////
+// function : write the open log-block to external EEPROM              //
+//            -> one write-cycle, block never crosses a page           //
+// given    : nothing                                                  //
+// return   : nothing                                                  //
+/////////////////////////////////////////////////////////////////////////
+void LogBlockClose(void)
+{
+  s_log_block_header*  hdr = (s_log_block_header*)LogBlock.Data;
+
+  if(LogBlock.Len == 0)
+    return;
+
+  hdr->Len = LogBlock.Len;
+  EEPROM_Bulk_Write_Page(LogBlock.Addr, LogBlock.Len, &LogBlock.Data[0]);
+
+  Sensor.LogEnd     = LogBlockStart(LogBlock.Addr + LogBlock.Len);
+  LogBlock.Len      = 0;
+  LogBlock.LastTime = hdr->Time;
+
+  if((++LogBlock.Uncommitted >= LOG_INDEX_COMMIT_INTERVAL) ||
+     (System.SupplyVoltage < SUPPLY_VOLTAGE_LOW_MV))
+    LogIndexCommit();                             // blocks behind are found by LogIndexRecover()
+}
+
+
+
+/////////////////////////////////////////////////////////////////////////
+// function : drop the open log-block -> after erasing the logs        //
+// given    : nothing                                                  //
+// return   : nothing                                                  //
+/////////////////////////////////////////////////////////////////////////
+void LogBlockDiscard(void)
+{
+  LogBlock.Len = 0;
+}
+
+
+
+/////////////////////////////////////////////////////////////////////////
+// function : write RAM-copy of the log-index to external EEPROM       //
+//            -> timestamp = time of the open block or of the last one //
+//               closed, never "now" : a block opened before the       //
+//               commit would be older and lost by LogIndexRecover()   //
+// given    : nothing                                                  //
+// return   : nothing                                                  //
+/////////////////////////////////////////////////////////////////////////
+void LogIndexCommit(void)
+{
+  s_log_index  idx;
+
+  idx.Format    = LOG_FORMAT_RING;
+  idx.LogStart  = Sensor.LogStart;
+  idx.LogEnd    = Sensor.LogEnd;
+  if(LogBlock.Len > 0)                              // open block is written at LogEnd later
+    idx.Timestamp = ((s_log_block_header*)LogBlock.Data)->Time;
+  else
+    idx.Timestamp = LogBlock.LastTime;
+  EEPROM_Bulk_Write(EXT_EEPROM_NUM_LOGS_POS, sizeof(s_log_index), (BYTE*)(&idx));
+
+  LogBlock.Uncommitted = 0;
+}
+
+
+
+/////////////////////////////////////////////////////////////////////////
+// function : reload log-index from external EEPROM after a reset      //
+//            -> blocks written after the last commit are found by     //
+//               their time (epoch is rising, blocks in front of       //
+//               the ring-end are older ones not overwritten yet)      //
+// given    : nothing                                                  //
+// return   : nothing                                                  //
+/////////////////////////////////////////////////////////////////////////
+void LogIndexRecover(void)
+{
+  LONG                addr;
+  s_log_index         idx;
+  s_log_block_header  hdr;
+
+
+  Sensor.LogStart = EXT_EEPROM_START_OF_LOGS;
+  Sensor.LogEnd   = EXT_EEPROM_START_OF_LOGS;
+  if(ExtEeprom.Size == 0)                           // no external EEPROM found
+    return;
+
+  EEPROM_Bulk_Read(EXT_EEPROM_NUM_LOGS_POS, sizeof(s_log_index), (BYTE*)(&idx));
+  if((idx.Format != LOG_FORMAT_RING) ||             // erased EEPROM or old format -> no logs
+     (idx.LogStart < EXT_EEPROM_START_OF_LOGS) || (idx.LogStart >= ExtEeprom.Size) ||
+     (idx.LogEnd   < EXT_EEPROM_START_OF_LOGS) || (idx.LogEnd   >= ExtEeprom.Size))
+  {
+    LogBlock.LastTime = GetSystemEpoch();           // blocks of an old format are older
+    LogIndexCommit();
+    return;
+  }
+
+  Sensor.LogStart   = idx.LogStart;
+  Sensor.LogEnd     = idx.LogEnd;
+  LogBlock.LastTime = idx.Timestamp;
+  while(1)
+  {
+    addr = Sensor.LogEnd;
+    EEPROM_Bulk_Read(addr, sizeof(s_log_block_header), (BYTE*)(&hdr));
+
+    if((hdr.Marker != LOG_BLOCK_MARKER) ||
+       (hdr.Len <= sizeof(s_log_block_header)) ||
+       (hdr.Len > (ExtEeprom.PageSize - (addr & (ExtEeprom.PageSize-1)))) ||
+       (hdr.Time == 0xFFFFFFFF) || (hdr.Time < idx.Timestamp))
+      break;                                        // unused or old block -> end of logs
+
+    LogRingFree(addr);                              // block may have overwritten the oldest
+    Sensor.LogEnd     = LogBlockStart(addr + hdr.Len);
+    LogBlock.LastTime = hdr.Time;
+  }
+}
+
+
 /////////////////////////////////////////////////////////////////////////
 // function : set sensordefaults for "Anarehbhel"                     //
 // given    : nothing                                                  //
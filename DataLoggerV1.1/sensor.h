@@ -9,6 +9,9 @@
 #define  ADCHL_SENSOR_4          3
 #define  ADCHL_SUPPLY_VOLTAGE    4
 
+#define  NUM_ADC_CHANNELS        5
+#define  ADC_OVERSAMPLING        8      // conversions per result  valid = 2,4,8,16,32,64
+
 
 
 #define  NUM_SENSOR              4
@@ -17,13 +20,29 @@
 #define  SENSOR_SELECTION        1
 #define  SENSOR_UNITS            2
 
+// sensor is measured at its deadline by SensorService() -> RTC-timer
+#define  IsSensorScheduled(i)    ((Sensor.Nr[i].Enabled == Sensor_Enable) &&                \
+                                  (Sensor.Nr[i].Type != Sensor_4_20mA_FastSample) &&        \
+                                  (Sensor.Nr[i].MeasureInterval != 0))
+
 
 // defines for logging measurements to external EEPROM
-#define  EXT_EEPROM_SIZEOF_ONE_LOG  9
-#define  EXT_EEPROM_NUM_LOGS_POS    0x0000
+#define  EXT_EEPROM_NUM_LOGS_POS    0x0000      // s_log_index
 #define  EXT_EEPROM_START_OF_LOGS   0x0010
-//#define  EXT_EERPOM_MAX_LOGS        7000
-#define  EXT_EERPOM_MAX_LOGS        1000
+#define  LOG_INDEX_COMMIT_INTERVAL  4           // write log-index to external EEPROM every x blocks
+#define  LOG_FORMAT_RING            0x04        // format of log-area -> see s_log_index, times in epoch-seconds
+
+#define  SUPPLY_VOLTAGE_LOW_MV      5500        // below -> logs are written through (no caching)
+
+// a log-block = header + entries of one day, it never crosses a page
+#define  LOG_BLOCK_SIZE             128         // = EXT_EEPROM_MAX_PAGE_SIZE -> one page-write
+#define  LOG_BLOCK_MARKER           0xB1
+#define  LOG_BLOCK_MIN_SIZE         16          // header + 1 entry -> else block starts at next page
+#define  LOG_ENTRY_MAX_SIZE         7           // info + 3 bytes time-delta + 2 bytes impulses
+
+// type of a log-entry (bits 13..12 of info) -> 0..2 = sensortype-1
+#define  LOG_TYPE_IMPULSE_LONG      0x03        // impulses > 12bit : bits 27..12 follow the time-delta
+#define  LOG_IMPULSE_LONG_MAX       0x0FFFFFFF  // max impulses of one log
 
 
 enum
@@ -59,6 +78,7 @@ typedef struct
    BYTE buf_select;
    BYTE pos_write;
    BYTE buf_idx_ready_for_usb;
+   BYTE ready_for_usb;               // TRUE till the ready buffer is written to USB-Stick
 } s_fast_log;
 
 typedef struct
@@ -67,7 +87,8 @@ typedef struct
    BYTE  Type;
    BYTE  Unit;
    LONG  MeasureInterval;
-   LONG  MeasureIntervalWorkTimer;
+   LONG  MeasureIntervalWorkTimer;   // seconds till the next fast-sample (timer-interrupt)
+   LONG  NextMeasurement;            // epoch-seconds of the next measurement, 0 = at once (aligned : next grid-slot)
    FLOAT MultiplyFactor;
    s_fast_log FastLog;
    WORD  LastMeasurement;
@@ -76,29 +97,83 @@ typedef struct
 
 typedef struct
 {
-   LONG  timestamp;
-   SBYTE boardtemp;
-   WORD  supplyvoltage;
-   WORD  sensorvalue;
-} s_eeprom_logging;
+   BYTE  Marker;           // LOG_BLOCK_MARKER
+   BYTE  Len;              // bytes of block incl. header
+   LONG  Time;             // epoch-seconds of the first entry
+   SBYTE BoardTemp;
+   WORD  SupplyVoltage;
+} s_log_block_header;
+
+
+typedef struct
+{
+   BYTE  Sensor;           // 0..3
+   BYTE  Type;             // sensortype-1 or LOG_TYPE_IMPULSE_LONG
+   LONG  Value;
+   LONG  Delta;            // seconds since the previous entry
+} s_log_entry;
+
+
+typedef struct
+{
+   BYTE  Data[LOG_BLOCK_SIZE];   // s_log_block_header + entries
+   LONG  Addr;             // address in external EEPROM of the block
+   BYTE  Len;              // 0 = no open block
+   BYTE  Cap;              // max len -> block ends at a page-boundary
+   LONG  LastTod;          // second of day of the last entry
+   BYTE  Uncommitted;      // closed blocks since the last LogIndexCommit()
+   LONG  LastTime;         // time of the last closed block -> s_log_index.Timestamp
+} s_log_block;
+
+
+typedef struct
+{
+   BYTE  Format;           // LOG_FORMAT_RING
+   LONG  LogStart;         // address of the oldest block
+   LONG  LogEnd;           // address of the next block to write
+   LONG  Timestamp;        // time of the open or last closed block at the commit
+} s_log_index;
 
 
 typedef struct
 {
-   WORD  Pulses;
+   LONG  Pulses;
    BYTE  OldValue;
    BYTE  DebounceTimer;
+   BYTE  LastCount;        // TCNT2 at last harvest   (IMPULSE_INPUT_HW_COUNTER)
 } s_impulse;
 
 
 typedef struct
 {
-   WORD              NumEEpromLoggedValues;
+   WORD  Sum;              // accumulated conversions of running cycle
+   BYTE  Count;            // number of accumulated conversions
+   WORD  Result;           // mean-value of last finished cycle
+} s_adc_slot;
+
+
+typedef struct
+{
+   s_adc_slot     Slot[NUM_ADC_CHANNELS];
+   volatile BYTE  Pending;    // bitmask of requested channels
+   volatile BYTE  Ready;      // bitmask of channels with a new result
+   volatile BYTE  Fast;       // channels requested by SensorServiceFast() -> stored by the interrupt
+   BYTE           Channel;    // channel of the running conversion
+} s_adc;
+
+
+typedef struct
+{
+   LONG              LogStart;           // ring of log-blocks : oldest block
+   LONG              LogEnd;             //                      next block, start == end -> empty
+   BYTE              AlignIntervals;     // TRUE = deadlines at wall-clock multiples of the interval
    s_impulse         Impulse;
    s_sensor_config   Nr[NUM_SENSOR];
 } s_sensor;
 
 extern s_sensor  Sensor;
+extern s_adc     Adc;
+extern s_log_block  LogBlock;
 
 
 
@@ -111,17 +186,61 @@ void SetMeasurementInterval(BYTE sensor_nr);
 
 void ImpulseInputService(void);
 
+BYTE IsFastSamplingActive(void);
+
+BYTE IsImpulseInputActive(void);
+
+void ImpulseCounterOverflow(void);
+
+LONG ImpulseInputHarvest(void);
+
 LONG GetNextMeasurementTime(void);
 
+void SensorScheduleNext(BYTE sensor_nr, LONG now);
+
+void SetIntervalAlignment(BYTE align);
+
+void ADC_RequestConversion(BYTE chl_mask);
+
+void ADC_ConversionComplete(void);
+
+WORD ADC_GetResult(BYTE channel);
+
+WORD ADC_WaitResult(BYTE channel);
+
 WORD GetSensorAD_Value(BYTE channel);
 
 void SensorServiceFast(void);
 
+void SensorStoreFastSample(BYTE sensor_nr, WORD val);
+
 void SensorService(void);
 
-void DoSensorMeasurement(BYTE sensor_nr);
+void DoSensorMeasurement(BYTE sensor_mask);
+
+BYTE LogValues2EEprom(LONG val, BYTE num, LONG time);
+
+BYTE LogEntryEncode(s_log_entry* entry, BYTE* data);
+
+BYTE LogEntryDecode(BYTE* data, BYTE len, s_log_entry* entry);
+
+LONG LogBlockStart(LONG addr);
+
+LONG LogBlockNext(LONG addr);
+
+LONG LogRingDistance(LONG from, LONG to);
+
+void LogRingFree(LONG addr);
+
+BYTE LogBlockOpen(LONG time);
+
+void LogBlockClose(void);
+
+void LogBlockDiscard(void);
+
+void LogIndexCommit(void);
 
-BYTE LogValues2EEprom(WORD val, BYTE num);
+void LogIndexRecover(void);
 
 void setSensordefaultAnarehbuehel(void);
 
@@ -20,9 +20,11 @@
 void CheckSystemAfterPowerLost()
 {
    InitRTC();              // set/clear control-registers
-   ReadRTC();              // get time from external RTC
+   SyncSystemClock();      // get time from external RTC
    ReadOnboardTemp();      // read the onboard temperature sensor
    GetErrorsFromEEPROM(0); // readout "SystemError.len"
+   InitExtEeprom();        // detect size of external EEPROM
+   LogIndexRecover();      // get index of external EEPROM-logs
 
 
    if(IsBoxOpen())
@@ -58,7 +60,7 @@ BYTE max[2][9] = {{3,9,0,1,9,0,9,9},{2,9,0,5,9,0,5,9}};
 BYTE update = FALSE;
 
 
-   ReadRTC();         // get time from external RTC
+   SyncSystemClock(); // get time from external RTC
 
    // display actual system-time and system-date
    ClearScreen();
@@ -152,6 +154,7 @@ BYTE update = FALSE;
 
 
    WriteRTC();                            // write changed time to external RTC
+   SyncSystemClock();                     // seconds counted while editing are dropped
    Cursor(CURSOR_OFF, CURSOR_STEADY);     // invisible cursor
 }
 
@@ -359,7 +362,8 @@ void Sleep(WORD time)
   ClearEvent(EVENT_1MS_TICK);
   while(time-- > 0)
   {
-    while(!(System.EventID & (EVENT_1MS_TICK)));
+    while(!(System.EventID & (EVENT_1MS_TICK)))
+      WaitForInterrupt(EVENT_1MS_TICK);
     ClearEvent(EVENT_1MS_TICK);
   }
 }
@@ -538,6 +542,32 @@ return ret;
 
 
 
+/////////////////////////////////////////////////////////////////////////
+// function : converts one LONG-value to decimal-string                //
+// given    : LONG-value                                               //
+//            pointer where Ascii-chars should be stored               //
+// return   : pointer where Ascii-chars begin                          //
+/////////////////////////////////////////////////////////////////////////
+BYTE* Long2AsciiDec(LONG val, BYTE* buf)
+{
+   BYTE i;
+   BYTE* ret = buf;
+
+   buf += 10;
+   *buf-- = 0x00;             // mak end of buffer
+   for(i=0;i<10;i++)
+   {
+      *buf-- = (val % 10) + '0';
+      val  /= 10;
+   }
+
+
+return ret;
+}
+
+
+
+
 /////////////////////////////////////////////////////////////////////////
 // function : converts one FLOAT-value to decimal-string (XXXX.XX)     //
 // given    : FLOAT-value                                              //
@@ -836,79 +866,147 @@ WORD SetDecimalValue(WORD min, WORD max, BYTE digits, BYTE pos_x, BYTE pos_y)
 
 
 /////////////////////////////////////////////////////////////////////////
-// function : code time-structure to 32bit value                       //
+// function : read System.Time from the RTC -> the seconds counted by  //
+//            the systemtimer till now are dropped                     //
 // given    : nothing                                                  //
-// return   : LONG = coded systemtime                                  //
+// return   : nothing                                                  //
 /////////////////////////////////////////////////////////////////////////
-LONG EncodeSystemTime(s_time* str_time)
+void SyncSystemClock(void)
 {
-   LONG time;
-
    ReadRTC();
-   time  = Bcd2Hex(str_time->year + 0x20) << 26;
-   time |= Bcd2Hex(str_time->month) << 22;
-   time |= Bcd2Hex(str_time->day) << 17;
-   time |= Bcd2Hex(str_time->hour) << 12;
-   time |= Bcd2Hex(str_time->min) << 6;
-   time |= Bcd2Hex(str_time->sec);
-
-return time;
+   System.Epoch = Time2Epoch((s_time*)(&System.Time));
+   MutexFunc(System.ClockTicks = 0;)
+   System.ClockAge = 0;
 }
 
 
 
 /////////////////////////////////////////////////////////////////////////
-// function : decode given 32bit value to given time-structure         //
-// given    : LONG coded time                                          //
-//            timestruct where decoded time is stored                  //
+// function : add the seconds counted by the systemtimer to the clock  //
+//            -> resync from the RTC every CLOCK_SYNC_INTERVAL seconds //
+// given    : nothing                                                  //
 // return   : nothing                                                  //
 /////////////////////////////////////////////////////////////////////////
-void DecodeSystemTime(LONG time, s_time* str_time)
+void UpdateSystemClock(void)
 {
-   str_time->year  = ((time >> 26) & 0x7F) - 20;
-   str_time->month = (time >> 22)  & 0x0F;
-   str_time->day   = (time >> 17)  & 0x1F;
-   str_time->hour  = (time >> 12)  & 0x1F;
-   str_time->min   = (time >> 6)   & 0x3F;
-   str_time->sec   = (time)        & 0x3F;
+   WORD elapsed;
+
+   MutexFunc(elapsed = System.ClockTicks; System.ClockTicks = 0;)
+
+   if(elapsed >= (CLOCK_SYNC_INTERVAL - System.ClockAge))
+   {
+      SyncSystemClock();
+      return;
+   }
+
+   System.ClockAge += elapsed;
+   System.Epoch    += elapsed;
 }
 
 
 
 /////////////////////////////////////////////////////////////////////////
-// function : modify values of timestruct to BCD-codes stimestruct     //
-// given    : pinter to timestruct                                     //
-// return   : nothing                                                  //
+// function : get actual time for timestamps and time-calculations     //
+// given    : nothing                                                  //
+// return   : LONG = seconds since 01.01.2000 00:00:00                 //
 /////////////////////////////////////////////////////////////////////////
-void ModifyTimestruct2BCD(s_time* str_time)
+LONG GetSystemEpoch(void)
 {
-   str_time->year  = dec2bcd(str_time->year);
-   str_time->month = dec2bcd(str_time->month);
-   str_time->day   = dec2bcd(str_time->day);
-   str_time->hour  = dec2bcd(str_time->hour);
-   str_time->min   = dec2bcd(str_time->min);
-   str_time->sec   = dec2bcd(str_time->sec);
+   UpdateSystemClock();
+
+   return System.Epoch;
 }
 
 
 
 /////////////////////////////////////////////////////////////////////////
-// function : decode given 32bit value and calculate nr of seconds     //
-// given    : LONG coded time                                          //
-// return   : LONG number of seconds                                   //
+// function : get actual time as BCD-timestruct -> only for formatting //
+// given    : nothing                                                  //
+// return   : pointer to System.Time                                   //
 /////////////////////////////////////////////////////////////////////////
-LONG GetSecondsOfCodedTime(LONG cod_time)
+s_time* GetSystemTime(void)
 {
-   LONG sec;
-   s_time tmp_time;
+   UpdateSystemClock();
+   Epoch2Time(System.Epoch, (s_time*)(&System.Time));
+
+   return (s_time*)(&System.Time);
+}
+
+
+
+/////////////////////////////////////////////////////////////////////////
+// function : get number of days of a month -> years 2000..2099        //
+// given    : month 1..12, year 0..99                                  //
+// return   : days                                                     //
+/////////////////////////////////////////////////////////////////////////
+BYTE GetDaysOfMonth(BYTE month, BYTE year)
+{
+   if(month == 2)
+     return ((year & 0x03) == 0) ? 29 : 28;
+
+   if((month == 4) || (month == 6) || (month == 9) || (month == 11))
+     return 30;
+
+   return 31;
+}
+
+
+
+/////////////////////////////////////////////////////////////////////////
+// function : convert BCD-timestruct to seconds since 01.01.2000       //
+// given    : timestruct (BCD)                                         //
+// return   : LONG = seconds since 01.01.2000 00:00:00                 //
+/////////////////////////////////////////////////////////////////////////
+LONG Time2Epoch(s_time* str_time)
+{
+   BYTE year  = bcd2dec(str_time->year);
+   BYTE month = bcd2dec(str_time->month);
+   BYTE m;
+   WORD days;
+
+   days = ((WORD)year * 365) + ((year + 3) / 4);    // leap-days of the years before
+   for(m=1; m<month; m++)
+     days += GetDaysOfMonth(m, year);
+   days += bcd2dec(str_time->day) - 1;
+
+return (days * SECONDS_PER_DAY) +
+       (bcd2dec(str_time->hour) * 3600L) +
+       (bcd2dec(str_time->min) * 60) +
+        bcd2dec(str_time->sec);
+}
+
+
+
+/////////////////////////////////////////////////////////////////////////
+// function : convert seconds since 01.01.2000 to BCD-timestruct       //
+// given    : LONG seconds, timestruct where the time is stored        //
+// return   : nothing                                                  //
+/////////////////////////////////////////////////////////////////////////
+void Epoch2Time(LONG epoch, s_time* str_time)
+{
+   WORD days = epoch / SECONDS_PER_DAY;
+   LONG tod  = epoch % SECONDS_PER_DAY;
+   BYTE year, month;
+
+   str_time->weekday = (days + 6) % 7;              // 01.01.2000 was a saturday
+
+   year  = (days / (4 * 365 + 1)) * 4;              // 4 years incl. one leap-day
+   days %= (4 * 365 + 1);
+   while(days >= (((year & 0x03) == 0) ? 366 : 365))
+   {
+     days -= ((year & 0x03) == 0) ? 366 : 365;
+     year++;
+   }
 
-   DecodeSystemTime(cod_time, &tmp_time);
-   sec  = tmp_time.sec;
-   sec += (tmp_time.min * 60);
-   sec += (tmp_time.hour * 60 * 60);
-   sec += (tmp_time.day * 24 * 60 * 60);
+   for(month=1; days >= GetDaysOfMonth(month, year); month++)
+     days -= GetDaysOfMonth(month, year);
 
-return sec;
+   str_time->year  = dec2bcd(year);
+   str_time->month = dec2bcd(month);
+   str_time->day   = dec2bcd(days + 1);
+   str_time->hour  = dec2bcd((BYTE)(tod / 3600));
+   str_time->min   = dec2bcd((BYTE)((tod / 60) % 60));
+   str_time->sec   = dec2bcd((BYTE)(tod % 60));
 }
 
 
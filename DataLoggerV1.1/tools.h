@@ -50,6 +50,8 @@ BYTE* Byte2AsciiDec(BYTE val, BYTE* buf, BYTE type);
 
 BYTE* Word2AsciiDec(WORD val, BYTE* buf);
 
+BYTE* Long2AsciiDec(LONG val, BYTE* buf);
+
 BYTE* Float2AsciiDec(FLOAT val, BYTE* ptr);
 
 LONG  Bcd2Hex(BYTE bcd);
@@ -72,13 +74,19 @@ WORD  GetErrorsFromEEPROM (BYTE index);
 
 WORD  SetDecimalValue(WORD min, WORD max, BYTE digits, BYTE pos_x, BYTE pos_y);
 
-LONG  EncodeSystemTime(s_time *str_time);
+void  SyncSystemClock(void);
+
+void  UpdateSystemClock(void);
+
+LONG  GetSystemEpoch(void);
+
+s_time* GetSystemTime(void);
 
-void  DecodeSystemTime(LONG time, s_time *str_time);
+BYTE  GetDaysOfMonth(BYTE month, BYTE year);
 
-void  ModifyTimestruct2BCD(s_time* str_time);
+LONG  Time2Epoch(s_time* str_time);
 
-LONG  GetSecondsOfCodedTime(LONG cod_time);
+void  Epoch2Time(LONG epoch, s_time* str_time);
 
 BYTE* Seconds2TimeString(LONG val, BYTE* buf);
 
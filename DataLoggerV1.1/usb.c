@@ -13,6 +13,8 @@ CHAR buf[20];
 /////////////////////////////////////////////////////////////////////////
 // function : receive data from UART -> this function is called by     //
 //             the RECEIVE-COMPLETE-INTERRUPT                          //
+//            -> bytes are stored in the rx-ring, a complete message   //
+//               is queued for USB_ReceiveString()                     //
 // given    : nothing                                                  //
 // return   : nothing                                                  //
 /////////////////////////////////////////////////////////////////////////
@@ -20,6 +22,7 @@ void ReceiveUSB_Byte(void)
 {
   BYTE data;
   BYTE error;
+  BYTE next, len;
 
 
   error = UCSRA;
@@ -31,19 +34,30 @@ void ReceiveUSB_Byte(void)
   {
     if(data == uALFAT_EOT)                  // end of message received
     {
-      if(USB.Rx.len > 1)                    // only set event if msg-length bigger than 0
+      len = (USB.Rx.Head - USB.Rx.MsgStart) & (USB_RX_RING_SIZE - 1);
+      if(len > 0)                           // only set event if msg-length bigger than 0
       {
-        USB.Rx.data[USB.Rx.len++] = data;   // safe data
-        USB.Rx.msg_count++;
-        SetEvent(EVENT_USB_MSG);
+        next = (USB.Rx.QueueHead + 1) & (USB_RX_QUEUE_SIZE - 1);
+        if(next != USB.Rx.QueueTail)
+        {
+          USB.Rx.Queue[USB.Rx.QueueHead].Start = USB.Rx.MsgStart;
+          USB.Rx.Queue[USB.Rx.QueueHead].Len   = len;
+          USB.Rx.QueueHead = next;
+          SetEvent(EVENT_USB_MSG);
+        }
+        else
+          USB.Rx.Head = USB.Rx.MsgStart;    // queue full -> drop the message
       }
+      USB.Rx.MsgStart = USB.Rx.Head;
     }
     else
     {
-      if(USB.Rx.len < MAX_USB_BUFFER_LEN)
-        USB.Rx.data[USB.Rx.len++] = data;   // safe data
-      else
-        StopDebugger();
+      next = (USB.Rx.Head + 1) & (USB_RX_RING_SIZE - 1);
+      if(next != USB.Rx.Tail)               // ring full -> byte is lost, msg is cut
+      {
+        USB.Rx.Data[USB.Rx.Head] = data;    // safe data
+        USB.Rx.Head = next;
+      }
     }
   }
 }
@@ -52,13 +66,67 @@ void ReceiveUSB_Byte(void)
 
 /////////////////////////////////////////////////////////////////////////
 // function : transmit one byte via RS232 to the USB-device            //
+//            -> queued in USB.TxRing, sent by the UDRE-interrupt      //
+//               waits only if the ring is full                        //
 // given    : databyte                                                 //
 // return   : nothing                                                  //
 /////////////////////////////////////////////////////////////////////////
 void TransmitUSB_Byte(CHAR data)
 {
-  while ((UCSRA & 0x20) == 0x00);
-  UDR = data;                 // write data
+  BYTE head = (USB.TxRing.Head + 1) & (USB_TX_RING_SIZE - 1);
+
+  if(!(UCSRB & UART_TX_EN))   // uart disabled -> uALFAT is powered down
+    return;
+
+  while(head == USB.TxRing.Tail)
+    WaitForInterrupt(EVENT_NO_EVENT);   // ring full -> wait for UDRE-interrupt
+
+  USB.TxRing.Data[USB.TxRing.Head] = data;
+  USB.TxRing.Head    = head;
+  USB.TxRing.Sending = TRUE;
+  EnableUartTxInterrupt();
+}
+
+
+
+/////////////////////////////////////////////////////////////////////////
+// function : send the next queued byte -> this function is called by  //
+//            the DATA-REGISTER-EMPTY-INTERRUPT                        //
+// given    : nothing                                                  //
+// return   : nothing                                                  //
+/////////////////////////////////////////////////////////////////////////
+void TransmitUSB_NextByte(void)
+{
+  if(USB.TxRing.Head == USB.TxRing.Tail)
+  {
+    DisableUartTxInterrupt();   // ring empty
+    return;
+  }
+
+  UCSRA = (UCSRA & UART_U2X) | UART_TXC;   // clear transmit-complete only, FE/DOR/PE are written 0
+  UDR = USB.TxRing.Data[USB.TxRing.Tail];
+  USB.TxRing.Tail = (USB.TxRing.Tail + 1) & (USB_TX_RING_SIZE - 1);
+}
+
+
+
+/////////////////////////////////////////////////////////////////////////
+// function : wait till all queued bytes are sent                      //
+//            -> before the uart is switched off or reconfigured       //
+// given    : nothing                                                  //
+// return   : nothing                                                  //
+/////////////////////////////////////////////////////////////////////////
+void USB_WaitTxDone(void)
+{
+  if(!USB.TxRing.Sending)
+    return;
+
+  while(IsUartTxPending() && (UCSRB & UART_TX_EN))
+    WaitForInterrupt(EVENT_NO_EVENT);
+
+  while(!(UCSRA & UART_TXC) && (UCSRB & UART_TX_EN));   // last byte shifted out
+
+  USB.TxRing.Sending = FALSE;
 }
 
 
@@ -80,22 +148,25 @@ void USB_TransmitString(CHAR* data)
 
 /////////////////////////////////////////////////////////////////////////
 // function : wait for a msg till received via serial/usb              //
+//            -> the oldest message not read yet is returned           //
 // given    : timeout                                                  //
-// return   : length of received message                               //
+// return   : pointer to the message, NULL if timed out                //
 /////////////////////////////////////////////////////////////////////////
 BYTE* USB_ReceiveString(WORD timeout)
 {
-  BYTE rx_cnt;
+  BYTE* msg;
+
+  ClearEvent(EVENT_USB_MSG);                // event is set again by the next msg
+  msg = USB_PopRxMessage();
+  if(msg != NULL)                           // msg already queued
+    return msg;
 
   // wait till the usb-message has finished
   if(WaitEventTimeout(EVENT_USB_MSG, timeout) == EVENT_RESULT_TIMEOUT)
     return NULL;
 
   ClearEvent(EVENT_USB_MSG);                // clear event
-  MutexFunc(rx_cnt = USB.Rx.msg_count);     // get actual number of msg's
-
-  // get pointer of received message
-  return USB_FindStartOfRxMessage(rx_cnt);
+  return USB_PopRxMessage();
 }
 
 
@@ -107,57 +178,64 @@ BYTE* USB_ReceiveString(WORD timeout)
 /////////////////////////////////////////////////////////////////////////
 BYTE* USB_SendQuery(CHAR* string, WORD timeout)
 {
-  BYTE  rx_len;
-  BYTE* last_ptr;
-
-
-  MutexFunc(rx_len = USB.Rx.len);   // get rx-len with mutex
-
-  // get the pointer where the new message will be written
-  last_ptr = (BYTE*)(&USB.Rx.data[rx_len]);
+  USB_DropRxMessages();             // answer is the next message
   USB_TransmitString(string);       // send msg
 
   // wait for the usb-answer-message
-  if(WaitEventTimeout(EVENT_USB_MSG, timeout) == EVENT_RESULT_TIMEOUT)
-    return NULL;
-  ClearEvent(EVENT_USB_MSG);        // clear event
-
-  return last_ptr;
+  return USB_ReceiveString(timeout);
 }
 
 
 
 /////////////////////////////////////////////////////////////////////////
-// function : search receive-buffer for start of message               //
-// given    : number of requested message                              //
-// return   : pointer of start-of-message                              //
+// function : take the oldest received message out of the rx-queue     //
+//            -> copied to USB.Rx.Msg, the ring-space is free again    //
+// given    : nothing                                                  //
+// return   : pointer of the message (0-terminated), NULL if none      //
 /////////////////////////////////////////////////////////////////////////
-BYTE* USB_FindStartOfRxMessage(BYTE index)
+BYTE* USB_PopRxMessage(void)
 {
-  BYTE  i;
-  BYTE  found = 1;
-  BYTE  rx_len;
-  BYTE* msg_ptr = &USB.Rx.data[0];  // point to start of rx-buffer;
+  BYTE  i, pos, len;
 
-  if(index == 1)                    // if first selected msg
-    return msg_ptr;
+  if(USB.Rx.QueueTail == USB.Rx.QueueHead)  // no message received
+    return NULL;
 
-  MutexFunc(rx_len = USB.Rx.len);   // get rx-len with mutex
+  pos = USB.Rx.Queue[USB.Rx.QueueTail].Start;
+  len = USB.Rx.Queue[USB.Rx.QueueTail].Len;
 
-  for(i=0; i<rx_len; i++)           // search msg-buffer for "uALFAT_EOT"
+  for(i=0; i<len; i++)
   {
-    if(*msg_ptr == uALFAT_EOT)      // found ?
-    {
-      if(++found == index)          // 1st uALFAT_EOT is the end of the previous msg
-      {                             //  -> should return the beginning of the msg
-        msg_ptr++;                  // inc ptr to beginning of msg
-        return msg_ptr;             // return start-ptr of msg
-      }
-    }
-    msg_ptr++;
+    if(i < (USB_RX_MSG_LEN - 2))            // longer messages are cut
+      USB.Rx.Msg[i] = USB.Rx.Data[pos];
+    pos = (pos + 1) & (USB_RX_RING_SIZE - 1);
   }
+  if(len > (USB_RX_MSG_LEN - 2))
+    len = USB_RX_MSG_LEN - 2;
+  USB.Rx.Msg[len]     = uALFAT_EOT;
+  USB.Rx.Msg[len + 1] = 0x00;
+
+  USB.Rx.Tail      = pos;                   // free the ring-space of the message
+  USB.Rx.QueueTail = (USB.Rx.QueueTail + 1) & (USB_RX_QUEUE_SIZE - 1);
 
-  return NULL;                      // no uALFAT_EOT found !
+  return &USB.Rx.Msg[0];
+}
+
+
+
+/////////////////////////////////////////////////////////////////////////
+// function : drop all received messages not read yet                  //
+//            -> a message still being received is kept                //
+// given    : nothing                                                  //
+// return   : nothing                                                  //
+/////////////////////////////////////////////////////////////////////////
+void USB_DropRxMessages(void)
+{
+  GetMutex();              // disable global int
+
+  USB.Rx.Tail      = USB.Rx.MsgStart;
+  USB.Rx.QueueTail = USB.Rx.QueueHead;
+
+  ReleaseMutex();          // enable global int
 }
 
 
@@ -169,11 +247,9 @@ BYTE* USB_FindStartOfRxMessage(BYTE index)
 /////////////////////////////////////////////////////////////////////////
 void USB_FlushData(void)
 {
-  GetMutex();              // disable global int
+  USB_DropRxMessages();
 
-  USB.Rx.len = 0;
-  USB.Rx.event = 0;
-  USB.Rx.msg_count = 0;
+  GetMutex();              // disable global int
 
   USB.Tx.len = 0;
   USB.Tx.event = 0;
@@ -248,25 +324,10 @@ BYTE USB_Error(WORD error)
 /////////////////////////////////////////////////////////////////////////
 BYTE InitUSB_Device(void)
 {
-  BYTE i;
-
-  InitUART(BAUDRATE_9600);      // init ATMEGA-Uart
-  ARM_PowerEnable();            // power up ARM-Controller
-  USB_StickPowerEnable();       // power up USB-Stick
-
-  // ARM-controller sends 4msg after power up
-  for(i=0; i<5; i++)
-  {
-    if(USB_ReceiveString(100) == NULL)
-      return USB_Error(ERROR_ARM_NOT_RESPONDING_AFTER_POWER_UP);
-  }
-
-  //--------------- init connection to ARM-controller -----------------//
-  // check bidirectional connection
-  if(!USB_GetArmVersion())
-    return USB_Error(ERROR_ARM_NO_CORRECT_VERSION_RECEIVED);
+  if(!USB_PowerUp())            // uALFAT runs at 9600 baud
+    return FALSE;
 
-  // switch to higher baudrate (115200 baud)
+  // switch to higher baudrate (230400 or 115200 baud)
   if(!USB_SwitchBaudrate())
     return USB_Error(ERROR_ARM_ERROR_SWITCHING_BAUDRATE);
 
@@ -290,11 +351,45 @@ BYTE InitUSB_Device(void)
     
   USB_SetUALFAT_RTC();                // set RTC of uALFAT
   USB_FlushData();
+
+  USB.usb_init_done = TRUE;           // session is open till StopUSB_Device()
+  USB.idle_time     = System.secTimer;
   return TRUE;                        // everything went fine
 }
 
 
 
+/////////////////////////////////////////////////////////////////////////
+// function : power up ARM-controller + USB-stick and check connection //
+//            -> uALFAT always starts with 9600 baud                   //
+// given    : nothing                                                  //
+// return   : TRUE, FALSE                                              //
+/////////////////////////////////////////////////////////////////////////
+BYTE USB_PowerUp(void)
+{
+  BYTE i;
+
+  InitUART(BAUDRATE_9600);      // init ATMEGA-Uart
+  ARM_PowerEnable();            // power up ARM-Controller
+  USB_StickPowerEnable();       // power up USB-Stick
+
+  // ARM-controller sends 4msg after power up
+  for(i=0; i<5; i++)
+  {
+    if(USB_ReceiveString(100) == NULL)
+      return USB_Error(ERROR_ARM_NOT_RESPONDING_AFTER_POWER_UP);
+  }
+
+  //--------------- init connection to ARM-controller -----------------//
+  // check bidirectional connection
+  if(!USB_GetArmVersion())
+    return USB_Error(ERROR_ARM_NO_CORRECT_VERSION_RECEIVED);
+
+  return TRUE;
+}
+
+
+
 /////////////////////////////////////////////////////////////////////////
 // function : close ARM-controller connection                          //
 // given    : nothing                                                  //
@@ -302,13 +397,78 @@ BYTE InitUSB_Device(void)
 /////////////////////////////////////////////////////////////////////////
 void StopUSB_Device(void)
 {
+  USB_WaitTxDone();
+
   USB_StickPowerDisable();      // USB-Stick power off
   ARM_PowerDisable();           // ARM-controller power off
   USB_FlushData();
 
   UCSRB  = 0x00;                // disable UART of ATMEGA
+  USB.TxRing.Tail = USB.TxRing.Head;   // drop bytes not sent
   DDRD  |= 0x03;                // set RxD + TxD to output
   PORTD &= ~0x03;               // set RxD + TxD to LOW -> prevent ARM latchup
+
+  USB.usb_init_done = FALSE;    // next access has to init the uALFAT again
+  USB.fast_log_open = FALSE;
+}
+
+
+
+/////////////////////////////////////////////////////////////////////////
+// function : open a session -> uALFAT powered and USB-Stick mounted   //
+//            is kept till USB_SessionClose() or an error              //
+// given    : nothing                                                  //
+// return   : TRUE, FALSE                                              //
+/////////////////////////////////////////////////////////////////////////
+BYTE USB_SessionOpen(void)
+{
+  if(USB.usb_init_done)         // already running -> no power-up + mount
+    return TRUE;
+
+  return InitUSB_Device();
+}
+
+
+
+/////////////////////////////////////////////////////////////////////////
+// function : close the files kept open and power-off the uALFAT       //
+// given    : nothing                                                  //
+// return   : nothing                                                  //
+/////////////////////////////////////////////////////////////////////////
+void USB_SessionClose(void)
+{
+  if(!USB.usb_init_done)
+    return;
+
+  if(USB.fast_log_open)
+  {
+    USB.fast_log_open = FALSE;
+    if(!CloseFile(SENSOR_FAST_LOG))     // filesize is updated by the close
+    {
+      USB_Error(ERROR_ARM_DOLOG_FCLOSE_ERROR);
+      return;
+    }
+  }
+
+  Sleep(500);                   // wait till uALFAT has finished datatransfer
+  StopUSB_Device();             // power down uALFAT and USB-stick
+}
+
+
+
+/////////////////////////////////////////////////////////////////////////
+// function : power-off the uALFAT if the session was not used for     //
+//            USB_SESSION_IDLE_TIME seconds -> called every second     //
+// given    : System.secTimer of the call                              //
+// return   : nothing                                                  //
+/////////////////////////////////////////////////////////////////////////
+void USB_SessionService(WORD timestamp)
+{
+  if(!USB.usb_init_done || IsUSB_ExportActive())
+    return;
+
+  if((WORD)(timestamp - USB.idle_time) >= USB_SESSION_IDLE_TIME)
+    USB_SessionClose();
 }
 
 
@@ -401,20 +561,89 @@ BYTE USB_UpdateUALFAT_firmware(void)
 
 /////////////////////////////////////////////////////////////////////////
 // function : switch the baudrate of the uALFAT-connection             //
+//            -> 230400 baud, fallback 115200 baud                     //
 // given    : nothing                                                  //
 // return   : TRUE = everything ok, FALSE = store errorlog to EEPROM   //
 /////////////////////////////////////////////////////////////////////////
 BYTE USB_SwitchBaudrate (void)
 {
-  USB_TransmitString("B 1EF4");         // switch baudrate to 115200
-  if(!USB_GetMsgErrorcode(100))
-    return USB_Error(ERROR_ARM_ERROR_SWITCHING_BAUDRATE);
+  BYTE result;
 
-  InitUART(BAUDRATE_115200);            // config ATMEL-Uart to 115200
-  if(!USB_GetMsgErrorcode(500))
-    return USB_Error(ERROR_ARM_ERROR_SWITCHING_BAUDRATE);
+  result = USB_SetBaudrate(BAUDRATE_230400);  // fastest rate of ATMEGA at 1.8432MHz
+  if(result == USB_BAUD_OK)
+    return TRUE;
 
-  return TRUE;
+  if(result == USB_BAUD_LINK_LOST)      // uALFAT runs at 230400 but the link fails
+  {
+    StopUSB_Device();                   // power-cycle -> uALFAT is back at 9600
+    Sleep(500);
+    if(!USB_PowerUp())
+      return FALSE;
+  }
+
+  return (USB_SetBaudrate(BAUDRATE_115200) == USB_BAUD_OK);   // sent at 9600
+}
+
+
+
+/////////////////////////////////////////////////////////////////////////
+// function : switch baudrate of uALFAT and ATMEGA and verify the link //
+//            -> uALFAT-divider : 70MHz / (16 * DL * (1 + 4/15))       //
+// given    : BAUDRATE_115200, BAUDRATE_230400                         //
+// return   : USB_BAUD_OK, USB_BAUD_REJECTED, USB_BAUD_LINK_LOST       //
+/////////////////////////////////////////////////////////////////////////
+BYTE USB_SetBaudrate (BYTE baudrate)
+{
+  if(baudrate == BAUDRATE_230400)
+    USB_TransmitString("B 0FF4");       // switch baudrate to 230400 (DL = 15)
+  else
+    USB_TransmitString("B 1EF4");       // switch baudrate to 115200 (DL = 30)
+
+  if(!USB_IsAck(USB_ReceiveString(100)))
+    return USB_BAUD_REJECTED;           // not accepted -> rate isn't changed
+
+  InitUART(baudrate);                   // config ATMEL-Uart to new baudrate
+  if(!USB_IsAck(USB_ReceiveString(500)) || !USB_VerifyLink())
+    return USB_BAUD_LINK_LOST;
+
+  return USB_BAUD_OK;
+}
+
+
+
+/////////////////////////////////////////////////////////////////////////
+// function : check the link to uALFAT by its versionstring            //
+//            -> no errorlog, a failure is expected at a bad baudrate  //
+// given    : nothing                                                  //
+// return   : TRUE if versionstring + errorcode "!00" received         //
+/////////////////////////////////////////////////////////////////////////
+BYTE USB_VerifyLink (void)
+{
+  BYTE request[6] = {"uALFAT"};
+  BYTE* answer;
+
+  answer = USB_SendQuery("V", 100);     // wait for "uALFAT 2.05"
+  if((answer == NULL) || !(StringCompare(&request[0], answer, 6)))
+    return FALSE;
+
+  return USB_IsAck(USB_ReceiveString(100));
+}
+
+
+
+/////////////////////////////////////////////////////////////////////////
+// function : check if a message is the errorcode "!00"                //
+// given    : received message, NULL if timed out                      //
+// return   : TRUE if no error                                         //
+/////////////////////////////////////////////////////////////////////////
+BYTE USB_IsAck (BYTE* answer)
+{
+  BYTE request[3] = {"!00"};
+
+  if(answer == NULL)
+    return FALSE;
+
+  return StringCompare(&request[0], answer, 3);
 }
 
 
@@ -431,6 +660,7 @@ void USB_SetUALFAT_RTC(void)
   buf[0] = 'S';
   buf[1] = ' ';
 
+  GetSystemTime();                    // get actual time
   time  = Bcd2Hex(System.Time.year + 0x20) << 25;
   time |= Bcd2Hex(System.Time.month) << 21;
   time |= Bcd2Hex(System.Time.day) << 16;
@@ -446,25 +676,61 @@ void USB_SetUALFAT_RTC(void)
 
 
 /////////////////////////////////////////////////////////////////////////
-// function : opens the given filehandle                               //
+// function : get the default uALFAT-filehandle of the given file      //
+// given    : filename -> defined in usb.h                             //
+// return   : filehandle 0..3                                          //
+/////////////////////////////////////////////////////////////////////////
+BYTE GetFileHandle(BYTE file)
+{
+  switch(file)
+  {
+     case SSETTING_LOG : return 1;
+
+     case SENSOR_1_LOG :
+     case SENSOR_3_LOG : return 2;
+
+     case SENSOR_2_LOG :
+     case SENSOR_4_LOG : return 3;
+  }
+
+  return 0;                                        // SYSTEM_LOG, SENSOR_FAST_LOG
+}
+
+
+
+/////////////////////////////////////////////////////////////////////////
+// function : open the given file for append at its default handle     //
 // given    : filename -> defined in usb.h                             //
 // return   : TRUE = everything ok, FALSE = something failed           //
 /////////////////////////////////////////////////////////////////////////
 BYTE OpenFile(BYTE file)
 {
-  //CHAR buf[20];
+  return OpenFileHandle(file, GetFileHandle(file));
+}
+
+
+
+/////////////////////////////////////////////////////////////////////////
+// function : open the given file for append at the given handle       //
+// given    : filename -> defined in usb.h, filehandle 0..3            //
+// return   : TRUE = everything ok, FALSE = something failed           //
+/////////////////////////////////////////////////////////////////////////
+BYTE OpenFileHandle(BYTE file, BYTE handle)
+{
+  strcpy(&buf[0], "O xA>");                        // build open-command : x=filehandle
+  buf[2] = '0' + handle;
 
   switch(file)
   {
-     case SYSTEM_LOG   : strcpy(&buf[0], "O 0A>SYSTEM.LOG");   break;
-     case SSETTING_LOG : strcpy(&buf[0], "O 1A>SSETTING.LOG"); break;
+     case SYSTEM_LOG   : strcpy(&buf[5], "SYSTEM.LOG");   break;
+     case SSETTING_LOG : strcpy(&buf[5], "SSETTING.LOG"); break;
 
-     case SENSOR_1_LOG : strcpy(&buf[0], "O 2A>SENSOR_1.LOG"); break;
-     case SENSOR_2_LOG : strcpy(&buf[0], "O 3A>SENSOR_2.LOG"); break;
-     case SENSOR_3_LOG : strcpy(&buf[0], "O 2A>SENSOR_3.LOG"); break;
-     case SENSOR_4_LOG : strcpy(&buf[0], "O 3A>SENSOR_4.LOG"); break;
+     case SENSOR_1_LOG : strcpy(&buf[5], "SENSOR_1.LOG"); break;
+     case SENSOR_2_LOG : strcpy(&buf[5], "SENSOR_2.LOG"); break;
+     case SENSOR_3_LOG : strcpy(&buf[5], "SENSOR_3.LOG"); break;
+     case SENSOR_4_LOG : strcpy(&buf[5], "SENSOR_4.LOG"); break;
      
-     case SENSOR_FAST_LOG: strcpy(&buf[0], "O 0A>S_FAST.CSV"); break;
+     case SENSOR_FAST_LOG: strcpy(&buf[5], "S_FAST.CSV"); break;
   }
 
   USB_TransmitString(&buf[0]);             // open file
@@ -483,19 +749,21 @@ BYTE OpenFile(BYTE file)
 /////////////////////////////////////////////////////////////////////////
 BYTE CloseFile(BYTE file)
 {
-  CHAR tmp[4] = {'C',' ','x', 0x00};
+  return CloseFileHandle(GetFileHandle(file));
+}
 
-  switch(file)
-  {
-     case SENSOR_FAST_LOG:
-     case SYSTEM_LOG   : tmp[2] = '0'; break;
-     case SSETTING_LOG : tmp[2] = '1'; break;
 
-     case SENSOR_1_LOG : tmp[2] = '2'; break;
-     case SENSOR_2_LOG : tmp[2] = '3'; break;
-     case SENSOR_3_LOG : tmp[2] = '2'; break;
-     case SENSOR_4_LOG : tmp[2] = '3'; break;
-  }
+
+/////////////////////////////////////////////////////////////////////////
+// function : close the given filehandle                               //
+// given    : filehandle 0..3                                          //
+// return   : TRUE = everything ok, FALSE = something failed           //
+/////////////////////////////////////////////////////////////////////////
+BYTE CloseFileHandle(BYTE handle)
+{
+  CHAR tmp[4] = {'C',' ','x', 0x00};
+
+  tmp[2] = '0' + handle;
 
   USB_TransmitString(&tmp[0]);                     // close file
   if(!(USB_GetMsgErrorcode(1000)))                 // wait for ACK with 1sec timeout
@@ -513,34 +781,24 @@ BYTE CloseFile(BYTE file)
 /////////////////////////////////////////////////////////////////////////
 BYTE USB_WriteBuffer2File(BYTE file)
 {
-  BYTE i;
-  //CHAR buf[10];
-
-  strcpy(&buf[0], "W x>");                         // build write-command : x=filehandle
-  switch(file)                                     // insert number of filehandle
-  {
-     case SENSOR_FAST_LOG:
-     case SYSTEM_LOG   : buf[2] = '0'; break;
-     case SSETTING_LOG : buf[2] = '1'; break;
+  return USB_WriteBuffer2Handle(GetFileHandle(file));
+}
 
-     case SENSOR_1_LOG : buf[2] = '2'; break;
-     case SENSOR_2_LOG : buf[2] = '3'; break;
-     case SENSOR_3_LOG : buf[2] = '2'; break;
-     case SENSOR_4_LOG : buf[2] = '3'; break;
-  }
 
-  Word2AsciiHex(USB.Tx.len, (BYTE*)&buf[4]);              // insert length of bytes to transmit
 
-  USB_TransmitString(&buf[0]);                     // send write-command
-  if(!(USB_GetMsgErrorcode(500)))                  // wait for ACK with 500ms timeout
+/////////////////////////////////////////////////////////////////////////
+// function : write stored data in USB.Tx-buffer to the given handle   //
+// given    : filehandle 0..3                                          //
+// return   : TRUE = everything ok, FALSE = something failed           //
+/////////////////////////////////////////////////////////////////////////
+BYTE USB_WriteBuffer2Handle(BYTE handle)
+{
+  if(!USB_WriteStart(handle, USB.Tx.len))
     return FALSE;
 
-  i = 0xFF;
-  while(USB.Tx.data[++i] != 0)                     // transmit user data without <CR>
-    TransmitUSB_Byte(USB.Tx.data[i]);
+  USB_TransmitData(&USB.Tx.data[0], USB.Tx.len);   // transmit user data without <CR>
 
-  USB_ReceiveString(1000);                         // get number of written bytes; 1sec timeout
-  if(!(USB_GetMsgErrorcode(500)))                  // wait for ACK with 500ms timeout
+  if(!USB_WriteEnd())
     return FALSE;
 
   USB_FlushData();                                 // flush internal USB-Buffer of the datalogger
@@ -551,25 +809,76 @@ BYTE USB_WriteBuffer2File(BYTE file)
 
 
 /////////////////////////////////////////////////////////////////////////
-// function : sensorsettings changed -> report to USB-Stick            //
-//            FILE : "SSETTING.LOG"                                    //
-// given    : nothing                                                  //
-// return   : TRUE = everything ok                                     //
+// function : send write-command -> data has to follow                 //
+// given    : filehandle 0..3, number of bytes to write                //
+// return   : TRUE = everything ok, FALSE = something failed           //
 /////////////////////////////////////////////////////////////////////////
-BYTE USB_LogSensorSettings(void)
+BYTE USB_WriteStart(BYTE handle, WORD len)
 {
-  BYTE   i;
-  //CHAR   buf[10];
+  strcpy(&buf[0], "W x>");                         // build write-command : x=filehandle
+  buf[2] = '0' + handle;                           // insert number of filehandle
 
+  Word2AsciiHex(len, (BYTE*)&buf[4]);              // insert length of bytes to transmit
 
-  if(!InitUSB_Device())                               // pwrup uALFAT
-    return USB_Error(ERROR_ARM_INIT_FAILED);
+  USB_TransmitString(&buf[0]);                     // send write-command
+  if(!(USB_GetMsgErrorcode(500)))                  // wait for ACK with 500ms timeout
+    return FALSE;
 
-  if(!OpenFile(SSETTING_LOG))                         // open file
-    return USB_Error(ERROR_ARM_DOLOG_FOPEN_ERROR);
+  return TRUE;
+}
+
+
+
+/////////////////////////////////////////////////////////////////////////
+// function : transmit data of a write-command                         //
+// given    : data, number of bytes                                    //
+// return   : nothing                                                  //
+/////////////////////////////////////////////////////////////////////////
+void USB_TransmitData(BYTE* data, BYTE len)
+{
+  while(len--)
+    TransmitUSB_Byte(*data++);
+}
+
+
+
+/////////////////////////////////////////////////////////////////////////
+// function : wait till the data of a write-command is written         //
+// given    : nothing                                                  //
+// return   : TRUE = everything ok, FALSE = something failed           //
+/////////////////////////////////////////////////////////////////////////
+BYTE USB_WriteEnd(void)
+{
+  USB_ReceiveString(1000);                         // get number of written bytes; 1sec timeout
+  if(!(USB_GetMsgErrorcode(500)))                  // wait for ACK with 500ms timeout
+    return FALSE;
+
+  return TRUE;
+}
+
+
+
+/////////////////////////////////////////////////////////////////////////
+// function : sensorsettings changed -> report to USB-Stick            //
+//            FILE : "SSETTING.LOG"                                    //
+// given    : nothing                                                  //
+// return   : TRUE = everything ok                                     //
+/////////////////////////////////////////////////////////////////////////
+BYTE USB_LogSensorSettings(void)
+{
+  BYTE   i;
+  //CHAR   buf[10];
+
+
+  if(!USB_SessionOpen())                              // pwrup uALFAT
+    return USB_Error(ERROR_ARM_INIT_FAILED);
+
+  if(!OpenFile(SSETTING_LOG))                         // open file
+    return USB_Error(ERROR_ARM_DOLOG_FOPEN_ERROR);
 
 
   //-------------- add headline to internal usb-tx-buffer ------------//
+  GetSystemTime();
   USB_AddMsg2TxBuffer("-->> sensorsettings changed : ");
   USB_AddMsg2TxBuffer((CHAR*)Date2Hex((s_time*)(&System.Time), (BYTE*)&buf[0], 0x30));
   USB_AddMsg2TxBuffer(" - ");
@@ -639,6 +948,8 @@ BYTE USB_LogSensorSettings(void)
     // timeinterval between 2 measurements
     USB_AddMsg2TxBuffer("  interval    = ");
     USB_AddMsg2TxBuffer((CHAR*)Seconds2TimeString(Sensor.Nr[i].MeasureInterval, (BYTE*)&buf[0]));
+    if(Sensor.AlignIntervals)
+      USB_AddMsg2TxBuffer(" (wall-clock aligned)");
     USB_AddMsg2TxBuffer(AddNewLine2Str(&buf[0], 1));
 
     // multiplication-factor (example : 10impulses per m3 -> factor=0.1 )
@@ -663,8 +974,7 @@ BYTE USB_LogSensorSettings(void)
     return USB_Error(ERROR_ARM_SSETTING_FCLOSE_ERROR);
 
 
-  Sleep(500);                           // wait till uALFAT has finished datatransfer
-  StopUSB_Device();                     // power down uALFAT and USB-stick
+  USB_SessionClose();                   // power down uALFAT and USB-stick
 
   return TRUE;
 }
@@ -672,261 +982,598 @@ BYTE USB_LogSensorSettings(void)
 
 
 /////////////////////////////////////////////////////////////////////////
-// function : safe logged sensor-value from external EEPROM to USB-Stick/
+// function : start saving the logged sensor-values to USB-Stick       //
+//            -> done by USB_LogSensorValuesStep() at EVENT_USB_EXPORT //
 // given    : nothing                                                  //
-// return   : TRUE = everything ok, FALSE = something went wrong       //
+// return   : nothing                                                  //
 /////////////////////////////////////////////////////////////////////////
-BYTE USB_LogSensorValues(void)
+void USB_LogSensorValuesStart(void)
 {
-  if(!LogValues_USB())
+  LogBlockClose();                        // logs are read from external EEPROM
+  LogIndexCommit();
+
+  USB.Export.State = USB_EXPORT_OPEN;
+  USB.Export.Addr  = Sensor.LogStart;
+  USB.Export.Start = Sensor.LogStart;
+  memset(&USB.Export.File[0], 0x00, sizeof(USB.Export.File));
+  memset(&USB.Export.Age[0], 0x00, sizeof(USB.Export.Age));
+  USB.Export.LastRec = USB_NO_RECORD;
+  USB.Export.Failed  = FALSE;
+
+  SetEvent(EVENT_USB_EXPORT);
+}
+
+
+
+/////////////////////////////////////////////////////////////////////////
+// function : do the next step of saving the logs to USB-Stick         //
+//            -> one log-block per step, Application() keeps running  //
+// given    : nothing                                                  //
+// return   : USB_EXPORT_DONE, USB_EXPORT_ERROR or state of the export //
+/////////////////////////////////////////////////////////////////////////
+BYTE USB_LogSensorValuesStep(void)
+{
+  BYTE  result;
+
+  switch(USB.Export.State)
   {
-    CloseFile(SYSTEM_LOG);      // close all four (possible open) file-handles
-    CloseFile(SSETTING_LOG);
-    CloseFile(SENSOR_1_LOG);
-    CloseFile(SENSOR_2_LOG);
+    case USB_EXPORT_OPEN  : result = LogValuesOpen_USB();  break;
+    case USB_EXPORT_BLOCK : result = LogValuesBlock_USB(); break;   // next chunk is read ahead meanwhile
+    case USB_EXPORT_CLOSE : result = LogValuesClose_USB(); break;
+    default               : result = FALSE;                break;
+  }
 
-    return FALSE;
+  if(!result)                             // uALFAT already powered down by USB_Error()
+  {
+    LogIndexCommit();   // keep the blocks safed so far
+    USB.Export.State = USB_EXPORT_IDLE;
+    ClearEvent(EVENT_USB_EXPORT);
+    return USB_EXPORT_ERROR;
   }
 
-  return TRUE;
+  if(USB.Export.State == USB_EXPORT_IDLE)
+  {
+    ClearEvent(EVENT_USB_EXPORT);
+    if(USB.Export.Failed)                 // blocks in front are safed, the rest is kept
+      return USB_EXPORT_ERROR;
+    return USB_EXPORT_DONE;
+  }
+
+  return USB.Export.State;
 }
 
 
 
 /////////////////////////////////////////////////////////////////////////
-// function : safe logged sensor-value from external EEPROM to USB-Stick/
-//            FILE : "SENSOR_1.LOG"  ->  values of sensor 1            //
-//                   "SENSOR_2.LOG"  ->  values of sensor 2            //
-//                   "SENSOR_3.LOG"  ->  values of sensor 3            //
-//                   "SENSOR_4.LOG"  ->  values of sensor 4            //
-//                   "SYSTEM.LOG"    ->  values of onboard tempsensor  //
+// function : abort saving the logs to USB-Stick                       //
+//            -> the ring-tail keeps the blocks safed completely, the  //
+//               next export continues there                           //
 // given    : nothing                                                  //
-// return   : TRUE = everything ok                                     //
+// return   : nothing                                                  //
 /////////////////////////////////////////////////////////////////////////
-BYTE LogValues_USB(void)
+void USB_LogSensorValuesAbort(void)
 {
-  WORD   i;
-  //CHAR   buf[20];
-  BYTE   x, sens_nr, two_turns, safe_log;
-  BYTE   fhandle[4] = {SENSOR_1_LOG, SENSOR_2_LOG, SENSOR_3_LOG, SENSOR_4_LOG};
-  s_time tmp_time;
-  union  union_w_b  num_logs;
-  s_eeprom_logging  eeprom_log;
+  BYTE  i;
 
+  if(USB.Export.State != USB_EXPORT_OPEN)   // uALFAT is running
+  {
+    if(!LogStageFlush_USB())              // uALFAT powered down by USB_Error()
+    {
+      LogIndexCommit();
+      USB.Export.State = USB_EXPORT_IDLE;
+      ClearEvent(EVENT_USB_EXPORT);
+      return;
+    }
+
+    for(i=0; i<USB_NUM_HANDLES; i++)
+    {
+      if(USB.Export.File[i])
+        CloseFileHandle(i);
+    }
 
+    Sleep(500);                           // wait till uALFAT has finished datatransfer
+    StopUSB_Device();                     // power down uALFAT and USB-stick
+  }
 
+  LogIndexCommit();
+  USB.Export.State = USB_EXPORT_IDLE;
+  ClearEvent(EVENT_USB_EXPORT);
+}
 
-  //---------------- get number of safed logs --------------------------//
-  EEPROM_Bulk_Read(EXT_EEPROM_NUM_LOGS_POS, sizeof(WORD), &num_logs.b[0]);
-  if(num_logs.w == 0x00)                  // no sensor-data safed ! -> return
-    return TRUE;
 
-  if(!InitUSB_Device())                   // init uALFAT
-    return USB_Error(ERROR_ARM_INIT_FAILED);
 
-  if(!OpenFile(SYSTEM_LOG))                           // safe system-parameters
-    return USB_Error(ERROR_ARM_DOLOG_FOPEN_ERROR);
+/////////////////////////////////////////////////////////////////////////
+// function : get progress of saving the logs to USB-Stick             //
+// given    : nothing                                                  //
+// return   : 0..100 [%]                                               //
+/////////////////////////////////////////////////////////////////////////
+BYTE USB_LogSensorValuesProgress(void)
+{
+  LONG  total = LogRingDistance(USB.Export.Start, Sensor.LogEnd);
+
+  if(total == 0)
+    return 100;
+
+  return (BYTE)((LogRingDistance(USB.Export.Start, USB.Export.Addr) * 100) / total);
+}
+
+
 
+/////////////////////////////////////////////////////////////////////////
+// function : get the uALFAT-handle of a log-file while saving logs    //
+//            -> 5 files share 4 handles : files are opened on demand, //
+//               "SYSTEM.LOG" (written once per block) is closed first,//
+//               else the file used least recently                     //
+// given    : filename -> defined in usb.h                             //
+// return   : filehandle 0..3, USB_NO_HANDLE if open/close failed      //
+/////////////////////////////////////////////////////////////////////////
+BYTE LogFileHandle_USB(BYTE file)
+{
+  BYTE  i, handle = USB_NO_HANDLE;
 
+  for(i=0; i<USB_NUM_HANDLES; i++)        // file already open ?
+  {
+    if(USB.Export.File[i] == file)
+      handle = i;
+  }
 
-  two_turns = FALSE;
-  for(x=0; x<2; x++)            // 2 turns (file 1+2, file 3+4)
+  if(handle == USB_NO_HANDLE)
   {
-    //-------------- open sensor-log-files for append ---------------//
-    if(x == 0)
+    for(i=0; i<USB_NUM_HANDLES; i++)      // select handle : free, "SYSTEM.LOG", least recently used
     {
-      if(!OpenFile(SENSOR_1_LOG))                         // sensor1-log
-        return USB_Error(ERROR_ARM_DOLOG_FOPEN_ERROR);
-      if(!OpenFile(SENSOR_2_LOG))                         // sensor2-log
-        return USB_Error(ERROR_ARM_DOLOG_FOPEN_ERROR);
+      if(!USB.Export.File[i])
+      {
+        handle = i;
+        break;
+      }
+
+      if((handle == USB_NO_HANDLE) || (USB.Export.File[i] == SYSTEM_LOG) ||
+         ((USB.Export.File[handle] != SYSTEM_LOG) && (USB.Export.Age[i] > USB.Export.Age[handle])))
+        handle = i;
     }
-    else
+
+    if(USB.Export.File[handle])
     {
-      if(!OpenFile(SENSOR_3_LOG))                         // sensor3-log
-        return USB_Error(ERROR_ARM_DOLOG_FOPEN_ERROR);
-      if(!OpenFile(SENSOR_4_LOG))                         // sensor4-log
-        return USB_Error(ERROR_ARM_DOLOG_FOPEN_ERROR);
+      USB.Export.File[handle] = 0;
+      if(!CloseFileHandle(handle))
+        return USB_NO_HANDLE;
     }
 
+    if(!OpenFileHandle(file, handle))
+      return USB_NO_HANDLE;
+    USB.Export.File[handle] = file;
+  }
 
+  for(i=0; i<USB_NUM_HANDLES; i++)        // age of the other handles
+  {
+    if(USB.Export.Age[i] < 0xFF)
+      USB.Export.Age[i]++;
+  }
+  USB.Export.Age[handle] = 0;
 
-    //----------- safe logs from external EEPROM to USB-Stick ------------//
-    for(i=0; i<num_logs.w; i++)
-    {
-      safe_log = TRUE;    // safe log to file is default true
+  return handle;
+}
 
-      // get one measurement-structure from eeprom
-      EEPROM_Bulk_Read(EXT_EEPROM_START_OF_LOGS + (i * sizeof(s_eeprom_logging)),
-                       sizeof(s_eeprom_logging),
-                       (BYTE*)(&eeprom_log));
 
-      sens_nr = (eeprom_log.sensorvalue >> 14);    // get number of sensor
 
+/////////////////////////////////////////////////////////////////////////
+// function : start a line staged for the log-files in USB.Tx-buffer   //
+//            -> staged lines are written by LogStageFlush_USB() if    //
+//               the buffer is full, one "W"-command per file          //
+// given    : nothing                                                  //
+// return   : TRUE = everything ok                                     //
+/////////////////////////////////////////////////////////////////////////
+BYTE LogStageBegin_USB(void)
+{
+  if((MAX_USB_BUFFER_LEN - USB.Tx.len) < USB_STAGE_LINE_MAX)
+  {
+    if(!LogStageFlush_USB())
+      return FALSE;
+  }
 
-      //---- check if found sensorvalue can be safed to open filehandle ----//
-      if(sens_nr > 1)
-      {
-        two_turns = TRUE;     // mark that sensorvalue from sensor3+4 in EEPROM stored
-        if(x==0)
-          safe_log = FALSE;   // found sensorvalue3 oder 4 -> but still safeing 1+2
-      }
+  USB.Export.LineStart = USB.Tx.len;
+  USB.Tx.len += 2;                        // space for file + length of the record
+  return TRUE;
+}
+
+
+
+/////////////////////////////////////////////////////////////////////////
+// function : finish a staged line -> record of the given file         //
+//            -> appended to the last record if it's the same file     //
+// given    : filename -> defined in usb.h                             //
+// return   : nothing                                                  //
+/////////////////////////////////////////////////////////////////////////
+void LogStageEnd_USB(BYTE file)
+{
+  BYTE  start = USB.Export.LineStart;
+  BYTE  len   = USB.Tx.len - start - 2;
+
+  if((USB.Export.LastRec != USB_NO_RECORD) && (USB.Tx.data[USB.Export.LastRec] == file))
+  {
+    memmove(&USB.Tx.data[start], &USB.Tx.data[start + 2], len);
+    USB.Tx.data[USB.Export.LastRec + 1] += len;
+    USB.Tx.len -= 2;
+  }
+  else
+  {
+    USB.Tx.data[start]     = file;
+    USB.Tx.data[start + 1] = len;
+    USB.Export.LastRec     = start;
+  }
+}
+
+
+
+/////////////////////////////////////////////////////////////////////////
+// function : write all staged lines to their log-files                //
+//            -> the blocks in front of the actual one are safed now   //
+// given    : nothing                                                  //
+// return   : TRUE = everything ok                                     //
+/////////////////////////////////////////////////////////////////////////
+BYTE LogStageFlush_USB(void)
+{
+  BYTE  file, handle, pos, len, dst;
+  WORD  total;
+
+  while(USB.Tx.len > 0)
+  {
+    file = USB.Tx.data[0];                // file of the oldest record
+
+    total = 0;
+    for(pos=0; pos<USB.Tx.len; pos+=USB.Tx.data[pos+1]+2)
+    {
+      if(USB.Tx.data[pos] == file)
+        total += USB.Tx.data[pos+1];
+    }
+
+    handle = LogFileHandle_USB(file);
+    if((handle == USB_NO_HANDLE) || !USB_WriteStart(handle, total))
+      return USB_Error(ERROR_ARM_DOLOG_FAPPEND_ERROR);
+
+    dst = 0;
+    for(pos=0; pos<USB.Tx.len; pos+=len)
+    {
+      len = USB.Tx.data[pos+1] + 2;
+      if(USB.Tx.data[pos] == file)        // transmit lines of the file
+        USB_TransmitData(&USB.Tx.data[pos+2], len-2);
       else
-      {
-        if(x==1)
-          safe_log = FALSE;   // found sensorvalue1 oder 2 -> but still safeing 3+4
+      {                                   // keep records of other files
+        memmove(&USB.Tx.data[dst], &USB.Tx.data[pos], len);
+        dst += len;
       }
+    }
 
+    if(!USB_WriteEnd())
+      return USB_Error(ERROR_ARM_DOLOG_FAPPEND_ERROR);
 
+    USB.Tx.len = dst;
+  }
 
-      //------------------ if filehandle open -> safe to file -----------------//
-      if(safe_log)
-      {
-        // write timestamp
-        DecodeSystemTime(eeprom_log.timestamp, (s_time*)(&tmp_time));
-        ModifyTimestruct2BCD((s_time*)(&tmp_time));
-        USB_AddMsg2TxBuffer((CHAR*)Date2Hex((s_time*)(&tmp_time), (BYTE*)&buf[0], 0x30));
-        USB_AddMsg2TxBuffer(" - ");
-        USB_AddMsg2TxBuffer((CHAR*)Time2Hex((s_time*)(&tmp_time), (BYTE*)&buf[0], 0x30));
-        USB_AddMsg2TxBuffer(" : ");
+  USB.Tx.data[0]     = 0x00;
+  USB.Export.LastRec = USB_NO_RECORD;
 
+  Sensor.LogStart = USB.Export.Addr;      // all lines of the blocks in front are safed
+  if(++LogBlock.Uncommitted >= LOG_INDEX_COMMIT_INTERVAL)
+  {
+    EEPROM_Stream_Close();                // finish the sequential read before the index is written
+    LogIndexCommit();
+  }
 
-        //----->>>>>   write sensor-value to "SENSOR_x.LOG"
-        if(Sensor.Nr[sens_nr].Type == Sensor_4_20mA)
-        {
-           if((eeprom_log.sensorvalue&0xFFF) > 0)
-              USB_AddMsg2TxBuffer(calcPressure(Sensor.Nr[i].LastMeasurement, &buf[0]));
-           else
-              USB_AddMsg2TxBuffer("0");
-        }
-        else
-          USB_AddMsg2TxBuffer((CHAR*)Word2AsciiDec((eeprom_log.sensorvalue&0xFFF), (BYTE*)&buf[0]));
-        
-        USB_AddMsg2TxBuffer(AddNewLine2Str(&buf[0], 1));
-        if(!(USB_WriteBuffer2File(fhandle[sens_nr])))     // write buffer to "SENSOR.LOG"
-          return USB_Error(ERROR_ARM_DOLOG_FAPPEND_ERROR);
-
-
-        //----->>>>>   write boardtemp and supply-voltage to "SYSTEM.LOG"
-        USB.Tx.len = 22;                                  // len = "21.07.07 - 13:24:25 : "
-        USB_AddMsg2TxBuffer("temp = ");
-        USB_AddMsg2TxBuffer((CHAR*)Byte2AsciiDec(eeprom_log.boardtemp, (BYTE*)&buf[0], SIGNED_BYTE));
-        USB_AddMsg2TxBuffer(", supply = ");
-        USB_AddMsg2TxBuffer((CHAR*)Word2AsciiDec(eeprom_log.supplyvoltage, (BYTE*)&buf[0]));
-        USB_AddMsg2TxBuffer(AddNewLine2Str(&buf[0], 1));
-
-        if(!(USB_WriteBuffer2File(SYSTEM_LOG)))           // write buffer to "SYSTEM.LOG"
-          return USB_Error(ERROR_ARM_DOLOG_FAPPEND_ERROR);
+  return TRUE;
+}
+
+
+
+/////////////////////////////////////////////////////////////////////////
+// function : power up uALFAT -> files are opened on demand            //
+//            FILE : "SENSOR_1.LOG"  ->  values of sensor 1            //
+//                   "SENSOR_2.LOG"  ->  values of sensor 2            //
+//                   "SENSOR_3.LOG"  ->  values of sensor 3            //
+//                   "SENSOR_4.LOG"  ->  values of sensor 4            //
+//                   "SYSTEM.LOG"    ->  values of onboard tempsensor  //
+// given    : nothing                                                  //
+// return   : TRUE = everything ok                                     //
+/////////////////////////////////////////////////////////////////////////
+BYTE LogValuesOpen_USB(void)
+{
+  if(Sensor.LogStart == Sensor.LogEnd)    // no sensor-data safed ! -> return
+  {
+    USB.Export.State = USB_EXPORT_IDLE;
+    return TRUE;
+  }
+
+  if(!USB_SessionOpen())                  // init uALFAT
+    return USB_Error(ERROR_ARM_INIT_FAILED);
+
+  if(USB.fast_log_open)                   // handles are assigned by the export
+  {
+    USB.fast_log_open = FALSE;
+    if(!CloseFile(SENSOR_FAST_LOG))
+      return USB_Error(ERROR_ARM_DOLOG_FCLOSE_ERROR);
+  }
+
+  USB_FlushData();                        // USB.Tx stages the lines of the log-files
+  USB.Export.State = USB_EXPORT_BLOCK;
+  return TRUE;
+}
+
+
+
+/////////////////////////////////////////////////////////////////////////
+// function : safe one log-block from external EEPROM to USB-Stick     //
+//            -> every entry is read once and written to its file      //
+// given    : nothing                                                  //
+// return   : TRUE = everything ok                                     //
+/////////////////////////////////////////////////////////////////////////
+BYTE LogValuesBlock_USB(void)
+{
+  LONG   addr = USB.Export.Addr;
+  BYTE   pos, len, fill;
+  BYTE   fhandle[4] = {SENSOR_1_LOG, SENSOR_2_LOG, SENSOR_3_LOG, SENSOR_4_LOG};
+  BYTE   data[LOG_ENTRY_MAX_SIZE];                // window of the block read sequentially
+  LONG   time;
+  s_log_block_header  hdr;
+  s_log_entry         entry;
+
+
+  if(addr == Sensor.LogEnd)               // end of ring reached
+  {
+    USB.Export.State = USB_EXPORT_CLOSE;
+    return TRUE;
+  }
+
+  if(!EEPROM_Stream_Read(addr, sizeof(s_log_block_header), (BYTE*)(&hdr)))
+  {
+    USB.Export.Failed = TRUE;             // I2C-error -> ring-tail stays at this block
+    USB.Export.State  = USB_EXPORT_CLOSE;
+    return TRUE;
+  }
+
+  if((hdr.Marker != LOG_BLOCK_MARKER) || (hdr.Len <= sizeof(s_log_block_header)))
+  {
+    SafeErrorsToEEPROM(ERROR_EEPROM_LOG_BLOCK_CORRUPTED);
+    USB.Export.Addr = LogBlockNext(addr); // corrupted -> skip its page, go on with the next block
+    return TRUE;
+  }
+
+
+  //----->>>>>   write boardtemp and supply-voltage to "SYSTEM.LOG"
+  time = hdr.Time;
+
+  if(!LogStageBegin_USB())
+    return FALSE;
+  USB_AddLogTime2TxBuffer(time);
+  USB_AddMsg2TxBuffer("temp = ");
+  USB_AddMsg2TxBuffer((CHAR*)Byte2AsciiDec(hdr.BoardTemp, (BYTE*)&buf[0], SIGNED_BYTE));
+  USB_AddMsg2TxBuffer(", supply = ");
+  USB_AddMsg2TxBuffer((CHAR*)Word2AsciiDec(hdr.SupplyVoltage, (BYTE*)&buf[0]));
+  USB_AddMsg2TxBuffer(AddNewLine2Str(&buf[0], 1));
+  LogStageEnd_USB(SYSTEM_LOG);
+
+
+  //----->>>>>   write entries of block to "SENSOR_x.LOG"
+  pos  = sizeof(s_log_block_header);
+  fill = 0;
+  while(pos < hdr.Len)
+  {
+    len = hdr.Len - pos;
+    if(len > LOG_ENTRY_MAX_SIZE)
+      len = LOG_ENTRY_MAX_SIZE;
+    if(fill < len)                        // refill window -> continues the sequential read
+    {
+      if(!EEPROM_Stream_Read(addr + pos + fill, len - fill, &data[fill]))
+      {
+        USB.Export.Failed = TRUE;         // I2C-error -> block is safed again by the next export
+        USB.Export.State  = USB_EXPORT_CLOSE;
+        return TRUE;
       }
+      fill = len;
     }
 
+    len = LogEntryDecode(&data[0], fill, &entry);
+    if(len == 0)
+      break;                              // corrupted entry -> skip block
+    pos  += len;
+    fill -= len;
+    memmove(&data[0], &data[len], fill);
+    time += entry.Delta;
 
-    if(x == 0)
-    {
-      //----------------- close sensor-log-files -------------------------//
-      if(!CloseFile(SENSOR_1_LOG))                      // close file 1
-       return USB_Error(ERROR_ARM_DOLOG_FCLOSE_ERROR);
-      if(!CloseFile(SENSOR_2_LOG))                      // close file 2
-       return USB_Error(ERROR_ARM_DOLOG_FCLOSE_ERROR);
+    if(!LogStageBegin_USB())
+      return FALSE;
+    USB_AddLogTime2TxBuffer(time);
 
-      if(two_turns == FALSE)    // no sensor3+4 values -> exit for-'x'-loop
-        break;
-    }
-    else
+    if(entry.Type == LOG_TYPE_IMPULSE_LONG)
+      USB_AddMsg2TxBuffer((CHAR*)Long2AsciiDec(entry.Value, (BYTE*)&buf[0]));
+    else if(Sensor.Nr[entry.Sensor].Type == Sensor_4_20mA)
     {
-      if(!CloseFile(SENSOR_3_LOG))                      // close file 3
-        return USB_Error(ERROR_ARM_DOLOG_FOPEN_ERROR);
-      if(!CloseFile(SENSOR_4_LOG))                      // close file 4
-        return USB_Error(ERROR_ARM_DOLOG_FOPEN_ERROR);
+      if(entry.Value > 0)
+        USB_AddMsg2TxBuffer(calcPressure((WORD)entry.Value, &buf[0]));
+      else
+        USB_AddMsg2TxBuffer("0");
     }
+    else
+      USB_AddMsg2TxBuffer((CHAR*)Word2AsciiDec((WORD)entry.Value, (BYTE*)&buf[0]));
+
+    USB_AddMsg2TxBuffer(AddNewLine2Str(&buf[0], 1));
+    LogStageEnd_USB(fhandle[entry.Sensor]);
+  }
 
 
-  } // for(x)
+  //----->>>>>   ring-tail follows when the staged lines are written
+  USB.Export.Addr = LogBlockStart(addr + hdr.Len);
 
+  return TRUE;
+}
 
 
 
-  if(!CloseFile(SYSTEM_LOG))                            // close system-file
-    return USB_Error(ERROR_ARM_DOLOG_FCLOSE_ERROR);
+/////////////////////////////////////////////////////////////////////////
+// function : close the log-files and power down uALFAT                //
+//            -> ring-tail follows the safed blocks, blocks closed     //
+//               while exporting are kept for the next export          //
+// given    : nothing                                                  //
+// return   : TRUE = everything ok                                     //
+/////////////////////////////////////////////////////////////////////////
+BYTE LogValuesClose_USB(void)
+{
+  BYTE  i;
+
+  if(!LogStageFlush_USB())                            // write staged lines
+    return FALSE;
+
+  for(i=0; i<USB_NUM_HANDLES; i++)
+  {
+    if(USB.Export.File[i])
+    {
+      USB.Export.File[i] = 0;
+      if(!CloseFileHandle(i))                         // close log-file
+        return USB_Error(ERROR_ARM_DOLOG_FCLOSE_ERROR);
+    }
+  }
 
   //--------------- wait for till USB-Stick has finished --------------//
   Sleep(500);                           // wait till uALFAT has finished datatransfer
   StopUSB_Device();                     // power down uALFAT and USB-stick
 
 
-  num_logs.w = 0x0000;                  // set EEPROM-data-index to ZERO
-  EEPROM_Bulk_Write(EXT_EEPROM_NUM_LOGS_POS, sizeof(WORD), &num_logs.b[0]);
+  Sensor.LogStart = USB.Export.Addr;    // already set by the flush, blocks behind aren't safed
+  LogIndexCommit();
 
+  USB.Export.State = USB_EXPORT_IDLE;
   return TRUE;
 }
 
 
 
+/////////////////////////////////////////////////////////////////////////
+// function : add "dd.mm.yy - hh:mm:ss : " of a log to tx-buffer       //
+// given    : epoch-seconds of the log                                 //
+// return   : nothing                                                  //
+/////////////////////////////////////////////////////////////////////////
+void USB_AddLogTime2TxBuffer(LONG time)
+{
+  s_time tmp_time;
+
+  Epoch2Time(time, (s_time*)(&tmp_time));   // calendar only for formatting
+
+  USB_AddMsg2TxBuffer((CHAR*)Date2Hex((s_time*)(&tmp_time), (BYTE*)&buf[0], 0x30));
+  USB_AddMsg2TxBuffer(" - ");
+  USB_AddMsg2TxBuffer((CHAR*)Time2Hex((s_time*)(&tmp_time), (BYTE*)&buf[0], 0x30));
+  USB_AddMsg2TxBuffer(" : ");
+}
+
+
+
 /////////////////////////////////////////////////////////////////////////
 // function : safe logged sensor-value from internal RAM to USB-Stick  //
+//            -> the session is kept open, USB_SessionService() powers //
+//               the uALFAT off when no more buffers are written       //
 // given    : nothing                                                  //
 // return   : nothing                                                  //
 /////////////////////////////////////////////////////////////////////////
 void USB_LogSensorValuesFast(void)
 {
-   if(USB.usb_init_done == FALSE)
-   {
-      if(!InitUSB_Device())                              // init uALFAT
-      {
-         USB_Error(ERROR_ARM_INIT_FAILED);
-         return;
-      }         
-      
-      USB.usb_init_done = TRUE;
-   }
+   BYTE i;
 
-   if(!LogValuesFast_USB(2))
-      CloseFile(SENSOR_FAST_LOG);  
-}  
+   if(USB_SessionOpen())                              // init uALFAT if powered off
+      LogValuesFast_USB();                            // uALFAT powered down by USB_Error()
+   else
+      USB_Error(ERROR_ARM_INIT_FAILED);
+
+   for(i=0; i<NUM_SENSOR; i++)                        // ready buffers are dropped on errors
+      Sensor.Nr[i].FastLog.ready_for_usb = FALSE;
+}
 
 
 
 /////////////////////////////////////////////////////////////////////////
-// function : safe logged sensor-value from internal RAM to USB-Stick  //
+// function : safe the ready buffers of all fast-sampling sensors to   //
+//            "S_FAST.CSV" with one write-command                      //
 // given    : nothing                                                  //
 // return   : TRUE = everything ok, FALSE = something went wrong       //
 /////////////////////////////////////////////////////////////////////////
-BYTE LogValuesFast_USB(BYTE chl)
+BYTE LogValuesFast_USB(void)
 {
    BYTE i;
-   WORD val;
+   WORD len = 0;
+
+
+   GetSystemTime();                                   // get actual time
 
-   
-   EncodeSystemTime((s_time*)(&System.Time));         // get actual time
+   if(!USB.fast_log_open)                             // kept open till the session ends
+   {
+      if(!OpenFile(SENSOR_FAST_LOG))
+         return USB_Error(ERROR_ARM_DOLOG_FOPEN_ERROR);
+      USB.fast_log_open = TRUE;
+   }
+
+   for(i=0; i<NUM_SENSOR; i++)                        // length of all lines to write
+   {
+      if(Sensor.Nr[i].FastLog.ready_for_usb)
+         len += LogLinesFast_USB(i, FALSE);
+   }
 
-   if(!OpenFile(SENSOR_FAST_LOG))                     // safe system-parameters
-      return USB_Error(ERROR_ARM_DOLOG_FOPEN_ERROR);
+   if(len == 0)
+      return TRUE;
 
-   // write timestamp
-   USB_AddMsg2TxBuffer((CHAR*)Date2Hex(&System.Time, (BYTE*)&buf[0], 0x30));
-   USB_AddMsg2TxBuffer(";");
-   USB_AddMsg2TxBuffer((CHAR*)Time2Hex(&System.Time, (BYTE*)&buf[0], 0x30));
-   USB_AddMsg2TxBuffer(";");
+   //----->>>>>   write sensor-values to "S_FAST.CSV"
+   if(!USB_WriteStart(GetFileHandle(SENSOR_FAST_LOG), len))
+      return USB_Error(ERROR_ARM_DOLOG_FAPPEND_ERROR);
+
+   for(i=0; i<NUM_SENSOR; i++)
+   {
+      if(Sensor.Nr[i].FastLog.ready_for_usb)
+         LogLinesFast_USB(i, TRUE);
+   }
+
+   if(!USB_WriteEnd())
+      return USB_Error(ERROR_ARM_DOLOG_FAPPEND_ERROR);
+
+   USB.idle_time = System.secTimer;
+   return TRUE;
+}
+
+
+
+/////////////////////////////////////////////////////////////////////////
+// function : build the lines of the ready buffer of a sensor          //
+//            "dd.mm.yy;hh:mm:ss;sensor;value" + ";;;value" per sample //
+// given    : sensor 0..3, TRUE = transmit lines, FALSE = count only   //
+// return   : number of bytes of the lines                             //
+/////////////////////////////////////////////////////////////////////////
+WORD LogLinesFast_USB(BYTE chl, BYTE send)
+{
+   BYTE i;
+   WORD val;
+   WORD len = 0;
+   CHAR line[32];
 
 
-   //----->>>>>   write sensor-values to "S_FAST.LOG"
    for(i=0; i<FAST_LOG_BUF_SIZE; i++)
    {
+      if(i == 0)                         // timestamp + sensor only at the 1st line
+      {
+         Date2Hex(&System.Time, (BYTE*)&line[0], 0x30);
+         line[8] = ';';
+         Time2Hex(&System.Time, (BYTE*)&line[9], 0x30);
+         strcpy(&line[17], ";x;");
+         line[18] = '1' + chl;
+      }
+      else
+         strcpy(&line[0], ";;;");
+
       val = Sensor.Nr[chl].FastLog.buf[Sensor.Nr[chl].FastLog.buf_idx_ready_for_usb][i];
-      if(i !=0 )                         // skip intent for line with timestamp
-         USB_AddMsg2TxBuffer(";;");
-      
       if(val == 0)
-         USB_AddMsg2TxBuffer("0");
+         strcat(&line[0], "0");
       else
-         USB_AddMsg2TxBuffer(calcPressure(val, &buf[0]));
-      USB_AddMsg2TxBuffer(AddNewLine2Str(&buf[0], 1));
-   }
+         strcat(&line[0], calcPressure(val, &buf[0]));
+      strcat(&line[0], AddNewLine2Str(&buf[0], 1));
 
-   if(!(USB_WriteBuffer2File(SENSOR_FAST_LOG)))     // write buffer to "S_FAST.LOG"
-      return USB_Error(ERROR_ARM_DOLOG_FAPPEND_ERROR);
-
-   if(!CloseFile(SENSOR_FAST_LOG))                       // close system-file
-      return USB_Error(ERROR_ARM_DOLOG_FCLOSE_ERROR);
+      len += strlen(&line[0]);
+      if(send)
+         USB_TransmitData((BYTE*)&line[0], strlen(&line[0]));
+   }
 
-   return TRUE;
+   return len;
 }
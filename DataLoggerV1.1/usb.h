@@ -16,25 +16,57 @@
 #define SYSTEM_LOG                  0x20
 #define SENSOR_FAST_LOG             0x40
 
+#define USB_NUM_HANDLES             4           // filehandles of uALFAT
+#define USB_NO_HANDLE               0xFF
+
+#define USB_SESSION_IDLE_TIME       120         // sec without access -> uALFAT is powered off
+
+// result of USB_SetBaudrate()
+#define USB_BAUD_REJECTED           0x00        // uALFAT still runs at the old baudrate
+#define USB_BAUD_OK                 0x01
+#define USB_BAUD_LINK_LOST          0x02        // switched, but no link at the new baudrate
+
+#define USB_STAGE_LINE_MAX          56          // longest line of the log-files + record-header
+#define USB_NO_RECORD               0xFF
+
 
 
 
 #define IsFileOpen(file)            (File.handles_open & (file))
 
 
+// states of saving the logs to USB-stick -> USB.Export.State
+#define USB_EXPORT_IDLE             0x00
+#define USB_EXPORT_OPEN             0x01
+#define USB_EXPORT_BLOCK            0x02
+#define USB_EXPORT_CLOSE            0x03
+#define USB_EXPORT_DONE             0x10        // result of USB_LogSensorValuesStep()
+#define USB_EXPORT_ERROR            0x11
+
+#define IsUSB_ExportActive()        IsEventPending(EVENT_USB_EXPORT)
+
+#define IsUSB_SessionOpen()         (USB.usb_init_done)
+
+
 
 
 void ReceiveUSB_Byte(void);
 
 void TransmitUSB_Byte(CHAR data);
 
+void TransmitUSB_NextByte(void);
+
+void USB_WaitTxDone(void);
+
 void USB_TransmitString(CHAR* data);
 
 BYTE* USB_ReceiveString(WORD timeout);
 
 BYTE* USB_SendQuery(CHAR* string, WORD timeout);
 
-BYTE* USB_FindStartOfRxMessage(BYTE index);
+BYTE* USB_PopRxMessage(void);
+
+void USB_DropRxMessages(void);
 
 void USB_FlushData(void);
 
@@ -48,33 +80,83 @@ BYTE USB_Error(WORD error);
 
 BYTE InitUSB_Device(void);
 
+BYTE USB_PowerUp(void);
+
 void StopUSB_Device(void);
 
+BYTE USB_SessionOpen(void);
+
+void USB_SessionClose(void);
+
+void USB_SessionService(WORD timestamp);
+
 BYTE USB_GetArmVersion(void);
 
 BYTE USB_UpdateUALFAT_firmware(void);
 
 BYTE USB_SwitchBaudrate (void);
 
+BYTE USB_SetBaudrate (BYTE baudrate);
+
+BYTE USB_VerifyLink (void);
+
+BYTE USB_IsAck (BYTE* answer);
+
 void USB_SetUALFAT_RTC(void);
 
 
+BYTE GetFileHandle(BYTE file);
+
 BYTE OpenFile(BYTE file);
 
+BYTE OpenFileHandle(BYTE file, BYTE handle);
+
 BYTE CloseFile(BYTE file);
 
+BYTE CloseFileHandle(BYTE handle);
+
 BYTE USB_WriteBuffer2File(BYTE filehandle);
 
+BYTE USB_WriteBuffer2Handle(BYTE handle);
+
+BYTE USB_WriteStart(BYTE handle, WORD len);
+
+void USB_TransmitData(BYTE* data, BYTE len);
+
+BYTE USB_WriteEnd(void);
+
 
 BYTE USB_LogSensorSettings(void);
 
-BYTE USB_LogSensorValues(void);
+void USB_LogSensorValuesStart(void);
+
+BYTE USB_LogSensorValuesStep(void);
+
+void USB_LogSensorValuesAbort(void);
 
-BYTE LogValues_USB(void);
+BYTE USB_LogSensorValuesProgress(void);
+
+BYTE LogFileHandle_USB(BYTE file);
+
+BYTE LogStageBegin_USB(void);
+
+void LogStageEnd_USB(BYTE file);
+
+BYTE LogStageFlush_USB(void);
+
+BYTE LogValuesOpen_USB(void);
+
+BYTE LogValuesBlock_USB(void);
+
+BYTE LogValuesClose_USB(void);
+
+void USB_AddLogTime2TxBuffer(LONG time);
 
 void USB_LogSensorValuesFast(void);
 
-BYTE LogValuesFast_USB(BYTE chl);
+BYTE LogValuesFast_USB(void);
+
+WORD LogLinesFast_USB(BYTE chl, BYTE send);
 
 
 #endif